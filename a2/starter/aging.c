@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <assert.h>
+#include <stdlib.h>
+#include "sim.h"
+#include "pagetable.h"
+
+extern int debug;
+
+//region DESCRIPTION OF AGING CLOCK IMPLEMENTATION
+
+/*
+ * CLOCK with an 8-bit age per frame instead of a single reference bit.
+ * Each time the arm passes a frame, the frame's age is shifted right and
+ * its PG_REF bit shifted in at the top, then PG_REF is cleared; the arm
+ * evicts the first frame whose age has decayed to 0. A page therefore
+ * survives 8 sweeps after its last reference rather than one, so pages in
+ * steady use are told apart from ones touched once by a scan.
+ *
+ * Every reference buys at most 8 steps of the arm, so eviction is O(1)
+ * amortized, and aging_ref() has nothing to do beyond the PG_REF bit that
+ * find_physpage() already sets.
+ * */
+
+//endregion
+
+// Each instance's s->alg_data
+typedef struct {
+    int arm;
+    unsigned char* age;
+} AgingClock;
+
+int aging_evict(struct sim* s) {
+    AgingClock* c = s->alg_data;
+
+    for (;;) {
+        int frame = c->arm;
+        pgtbl_entry_t* pte = s->coremap[frame].pte;
+
+        c->arm = (c->arm + 1) % s->memsize;
+        c->age[frame] >>= 1;
+        if (pte_test(pte, PG_REF)) {
+            c->age[frame] |= 0x80;
+            if (s->concurrent) {
+                pte_clear_atomic(pte, PG_REF);
+            } else {
+                pte_clear(pte, PG_REF);
+            }
+        }
+        if (c->age[frame] == 0) {
+            return frame;
+        }
+    }
+}
+
+void aging_ref(struct sim* s, pgtbl_entry_t* p) {
+    return;
+}
+
+void aging_init(struct sim* s) {
+    AgingClock* c = malloc(sizeof(AgingClock));
+    c->arm = 0;
+    c->age = calloc(s->memsize, sizeof(unsigned char));
+    s->alg_data = c;
+}
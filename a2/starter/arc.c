@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <assert.h>
+#include <stdlib.h>
+#include "sim.h"
+#include "pagetable.h"
+#include "pagemap.h"
+
+extern int debug;
+
+//region DESCRIPTION OF ARC IMPLEMENTATION
+
+/*
+ * Adaptive Replacement Cache (Megiddo and Modha, FAST '03). Resident pages
+ * are split between T1 (seen once recently) and T2 (seen at least twice),
+ * and the pages most recently evicted from each are remembered in the ghost
+ * lists B1 and B2. A miss on a ghost means its list was too small: a B1 hit
+ * grows the target size p of T1, a B2 hit shrinks it, and eviction takes
+ * from whichever of T1 and T2 is over its share. A one-off scan only ever
+ * passes through T1, so it cannot flush the pages in T2.
+ *
+ * All four lists live in one PageMap, so every step is O(1). Eviction needs
+ * the page being faulted in (s->fault_pte) to adapt p before choosing a
+ * victim; arc_ref() then moves that page into T1 or T2.
+ * */
+
+//endregion
+
+#define T1 0
+#define T2 1
+#define B1 2
+#define B2 3
+
+// Each instance's s->alg_data
+typedef struct {
+    PageMap* map;
+    int p;      // Target size of T1
+} Arc;
+
+int arc_evict(struct sim* s) {
+    Arc* a = s->alg_data;
+    PageMap* m = a->map;
+    int c = (int) s->memsize;
+    int node = pagemap_find(m, s->fault_pte);
+    int in_b2 = node != PM_NONE && m->nodes[node].list == B2;
+
+    // Adapt the target to the ghost hit, if any
+    if (node != PM_NONE && m->nodes[node].list == B1) {
+        int delta = m->len[B2] > m->len[B1] ? m->len[B2] / m->len[B1] : 1;
+        a->p = a->p + delta < c ? a->p + delta : c;
+    } else if (in_b2) {
+        int delta = m->len[B1] > m->len[B2] ? m->len[B1] / m->len[B2] : 1;
+        a->p = a->p - delta > 0 ? a->p - delta : 0;
+    }
+
+    // REPLACE: evict from T1 if it is over target, else from T2
+    int from = m->len[T1] > 0 &&
+               (m->len[T1] > a->p || (in_b2 && m->len[T1] == a->p)) ? T1 : T2;
+    if (m->len[from] == 0) {
+        from = from == T1 ? T2 : T1;
+    }
+    int victim = pagemap_tail(m, from);
+    assert(victim != PM_NONE);
+
+    int frame = m->nodes[victim].frame;
+    m->nodes[victim].frame = PM_NONE;
+    pagemap_move(m, victim, from == T1 ? B1 : B2);
+    return frame;
+}
+
+void arc_ref(struct sim* s, pgtbl_entry_t* p) {
+    Arc* a = s->alg_data;
+    PageMap* m = a->map;
+    int c = (int) s->memsize;
+    int node = pagemap_find(m, p);
+
+    if (node != PM_NONE) {
+        // A hit, or a miss on a ghost: either way it has now been seen twice
+        m->nodes[node].frame = (int) pte_frame(p);
+        pagemap_move(m, node, T2);
+        return;
+    }
+
+    // A page not seen recently. Keep T1 + B1 within c and the directory
+    // within 2c by forgetting the oldest ghosts.
+    if (m->len[T1] + m->len[B1] >= c && m->len[B1] > 0) {
+        pagemap_remove(m, pagemap_tail(m, B1));
+    } else if (m->len[T1] + m->len[T2] + m->len[B1] + m->len[B2] >= 2 * c &&
+               m->len[B2] > 0) {
+        pagemap_remove(m, pagemap_tail(m, B2));
+    }
+    pagemap_add(m, p, (int) pte_frame(p), T1);
+}
+
+void arc_init(struct sim* s) {
+    Arc* a = malloc(sizeof(Arc));
+    a->map = pagemap_create(4, 2 * s->memsize + 1);
+    a->p = 0;
+    s->alg_data = a;
+}
@@ -0,0 +1,85 @@
+/* File:     Swap bitmap microbenchmark
+ *
+ * Purpose:  Measure swap slot allocation and free throughput at a given
+ *           swap occupancy.
+ *
+ * Compile:  make bench_bitmap
+ * Run:      ./bench_bitmap [number of slots] [number of operations]
+ *
+ * Output:   ns per alloc/free pair at 10%, 50% and 99% occupancy.
+ *
+ * Notes:
+ * 1.  The bitmap is first filled to the target occupancy, then each
+ *     operation frees a random allocated slot and allocates a new one,
+ *     which keeps the occupancy steady.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "traceprogs/timer.h"
+
+// Bitmap functions from swap.c
+struct bitmap;
+
+extern struct bitmap* bitmap_create(unsigned nbits);
+
+extern int bitmap_alloc(struct bitmap* b, unsigned* index);
+
+extern void bitmap_unmark(struct bitmap* b, unsigned index);
+
+extern void bitmap_destroy(struct bitmap* b);
+
+int occupancies[] = {10, 50, 99};
+int num_occupancies = sizeof(occupancies) / sizeof(occupancies[0]);
+
+double run_bitmap(unsigned nbits, int occupancy, long nops) {
+    struct bitmap* b = bitmap_create(nbits);
+    unsigned nused = (unsigned) ((unsigned long) nbits * occupancy / 100);
+    unsigned* used = malloc(nused * sizeof(unsigned));
+    double start, finish;
+    unsigned i;
+    long op;
+
+    for (i = 0; i < nused; i++) {
+        if (bitmap_alloc(b, &used[i]) != 0) {
+            fprintf(stderr, "bitmap filled early\n");
+            exit(1);
+        }
+    }
+
+    srandom(1);
+    GET_TIME(start);
+    for (op = 0; op < nops; op++) {
+        unsigned victim = random() % nused;
+        bitmap_unmark(b, used[victim]);
+        if (bitmap_alloc(b, &used[victim]) != 0) {
+            fprintf(stderr, "bitmap_alloc failed\n");
+            exit(1);
+        }
+    }
+    GET_TIME(finish);
+
+    free(used);
+    bitmap_destroy(b);
+    return finish - start;
+}
+
+int main(int argc, char* argv[]) {
+    unsigned nbits = 1 << 22;
+    long nops = 1000000;
+    int i;
+
+    if (argc > 1) {
+        nbits = (unsigned) strtoul(argv[1], NULL, 10);
+    }
+    if (argc > 2) {
+        nops = strtol(argv[2], NULL, 10);
+    }
+
+    printf("%u slots, %ld alloc/free pairs\n", nbits, nops);
+    for (i = 0; i < num_occupancies; i++) {
+        double elapsed = run_bitmap(nbits, occupancies[i], nops);
+        printf("%3d%% occupancy: %8.1f ns per pair\n", occupancies[i],
+               elapsed * 1e9 / nops);
+    }
+    return 0;
+}
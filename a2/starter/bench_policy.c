@@ -0,0 +1,149 @@
+/* File:     Replacement policy microbenchmark
+ *
+ * Purpose:  Measure the per-reference cost of replacement policies as the
+ *           number of frames grows, without the page table walk or swap
+ *           I/O that dominate a full sim run.
+ *
+ * Compile:  make bench_policy
+ * Run:      ./bench_policy [number of references per run]
+ *
+ * Output:   ns per reference for every policy at every memsize.
+ *
+ * Notes:
+ * 1.  References are drawn uniformly from 2 * memsize pages, so roughly
+ *     half of them miss and evict once memory is full.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+#include "pagetable.h"
+#include "traceprogs/timer.h"
+
+// Globals normally defined by sim.c, used by the policies
+int debug = 0;
+
+//region TIMESTAMP LRU (REFERENCE IMPLEMENTATION)
+
+typedef struct {
+    unsigned long* timestamp_list; // Indexed by frame number
+    unsigned long timestamp;
+} Timestamps;
+
+static int lru_ts_evict(struct sim* s) {
+    Timestamps* ts = s->alg_data;
+    int i;
+    int oldest_ind = 0; // Index of oldest frame
+
+    for (i = 0; i < s->memsize; i++) {
+        if (ts->timestamp_list[i] < ts->timestamp_list[oldest_ind]) {
+            oldest_ind = i;
+        }
+    }
+    return oldest_ind;
+}
+
+static void lru_ts_ref(struct sim* s, pgtbl_entry_t* p) {
+    Timestamps* ts = s->alg_data;
+    int frame_number = pte_frame(p);
+    ts->timestamp_list[frame_number] = ts->timestamp;
+    ts->timestamp++;
+}
+
+static void lru_ts_init(struct sim* s) {
+    Timestamps* ts = malloc(sizeof(Timestamps));
+    ts->timestamp = 0;
+    ts->timestamp_list = calloc((size_t) s->memsize, sizeof(unsigned long));
+    s->alg_data = ts;
+}
+
+//endregion
+
+struct functions policies[] = {
+        {"lru-ts", lru_ts_init, lru_ts_ref, lru_ts_evict},
+        {"lru",    lru_init,    lru_ref,    lru_evict},
+        {"fifo",   fifo_init,   fifo_ref,   fifo_evict},
+        {"arc",    arc_init,    arc_ref,    arc_evict},
+        {"clockpro", clockpro_init, clockpro_ref, clockpro_evict},
+        {"2q",     twoq_init,   twoq_ref,   twoq_evict},
+        {"aging",  aging_init,  aging_ref,  aging_evict},
+};
+int num_policies = sizeof(policies) / sizeof(policies[0]);
+
+unsigned memsizes[] = {1024, 4096, 16384, 65536};
+int num_memsizes = sizeof(memsizes) / sizeof(memsizes[0]);
+
+/* Replays nrefs uniformly random page references through policy p with
+ * memsize frames and returns the elapsed time in seconds. Only the parts of
+ * the simulator instance that policies use are filled in.
+ */
+double run_policy(struct functions* p, unsigned memsize, unsigned npages,
+                  long nrefs) {
+    pgtbl_entry_t* ptes = calloc(npages, sizeof(pgtbl_entry_t));
+    struct sim sim;
+    struct frame* coremap;
+    unsigned next_free = 0;
+    double start, finish;
+    long i;
+
+    memset(&sim, 0, sizeof(sim));
+    sim.memsize = memsize;
+    sim.alg = p;
+    sim.coremap = coremap = calloc(memsize, sizeof(struct frame));
+    srandom(1);
+    p->init(&sim);
+
+    GET_TIME(start);
+    for (i = 0; i < nrefs; i++) {
+        pgtbl_entry_t* pte = &ptes[random() % npages];
+
+        if (!pte_test(pte, PG_VALID)) {
+            int frame;
+            if (next_free < memsize) {
+                frame = next_free++;
+            } else {
+                sim.fault_pte = pte;
+                frame = p->evict(&sim);
+                pte_clear(coremap[frame].pte, PG_VALID | PG_REF);
+            }
+            coremap[frame].in_use = 1;
+            coremap[frame].pte = pte;
+            pte_set_frame(pte, (unsigned) frame);
+        }
+        pte_set(pte, PG_VALID | PG_REF);
+        p->ref(&sim, pte);
+    }
+    GET_TIME(finish);
+
+    free(coremap);
+    free(ptes);
+    return finish - start;
+}
+
+int main(int argc, char* argv[]) {
+    long nrefs = 200000;
+    int i, j;
+
+    if (argc > 1) {
+        nrefs = strtol(argv[1], NULL, 10);
+    }
+
+    printf("%-10s", "memsize");
+    for (j = 0; j < num_policies; j++) {
+        printf("%12s", policies[j].name);
+    }
+    printf("   (ns per reference, %ld references)\n", nrefs);
+
+    for (i = 0; i < num_memsizes; i++) {
+        unsigned memsize = memsizes[i];
+        printf("%-10u", memsize);
+        for (j = 0; j < num_policies; j++) {
+            double elapsed = run_policy(&policies[j], memsize, 2 * memsize,
+                                        nrefs);
+            printf("%12.1f", elapsed * 1e9 / nrefs);
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,200 @@
+/* File:     Concurrent replay scaling benchmark
+ *
+ * Purpose:  Measure how replay throughput scales with the number of
+ *           threads replaying one instance (sim -c), on reference streams
+ *           shaped like the traceprogs matmul and blocked programs.
+ *
+ * Compile:  make bench_replay
+ * Run:      ./bench_replay [max threads]
+ *
+ * Output:   Millions of references per second and the speedup over one
+ *           thread, for 1..max threads (default: the number of CPUs),
+ *           with clock and aging, when everything fits in memory and when a
+ *           tenth of it does.
+ *
+ * Notes:
+ * 1.  The streams are generated at page granularity from the loops of
+ *     matmul.c and blocked.c (n = 100, blocks of 25, 128 byte records),
+ *     instead of being read from traces, so the benchmark needs no
+ *     valgrind run.
+ * 2.  Swap is kept in memory (sim -S mem) so disk I/O doesn't dominate.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sim.h"
+#include "pagetable.h"
+#include "concurrent.h"
+#include "traceprogs/timer.h"
+
+// Globals normally defined by sim.c
+int debug = 0;
+
+#define N       100
+#define BLOCK   25
+#define RECORD  128
+
+struct functions policies[] = {
+        {"clock", clock_init, clock_ref, clock_evict},
+        {"aging", aging_init, aging_ref, aging_evict},
+};
+int num_policies = sizeof(policies) / sizeof(policies[0]);
+
+static void add_ref(struct trace_buf* b, char type, addr_t vaddr) {
+    b->types[b->nrefs] = type;
+    b->vaddrs[b->nrefs] = vaddr & PAGE_MASK;
+    b->pids[b->nrefs] = 0;
+    b->nrefs++;
+}
+
+static struct trace_buf* new_buf(size_t capacity) {
+    struct trace_buf* b = malloc(sizeof(struct trace_buf));
+    b->types = malloc(capacity);
+    b->vaddrs = malloc(capacity * sizeof(addr_t));
+    b->pids = malloc(capacity * sizeof(unsigned));
+    b->nrefs = 0;
+    return b;
+}
+
+static void free_buf(struct trace_buf* b) {
+    free(b->types);
+    free(b->vaddrs);
+    free(b->pids);
+    free(b);
+}
+
+// Where the matrices would be, one after another, and record i of each
+#define A(i) (0x10000000UL + (addr_t) (i) * RECORD)
+#define B(i) (A(N * N) + (addr_t) (i) * RECORD)
+#define C(i) (B(N * N) + (addr_t) (i) * RECORD)
+
+// C = A * B with the naive triple loop, as in matmul.c
+static struct trace_buf* matmul_refs(void) {
+    struct trace_buf* b = new_buf((size_t) N * N * (2 * N + 1));
+    int i, j, k;
+
+    for (i = 0; i < N; i++) {
+        for (j = 0; j < N; j++) {
+            for (k = 0; k < N; k++) {
+                add_ref(b, 'L', A(i * N + k));
+                add_ref(b, 'L', B(k * N + j));
+            }
+            add_ref(b, 'M', C(i * N + j));
+        }
+    }
+    return b;
+}
+
+// C = A * B one BLOCK x BLOCK block at a time, as in blocked.c, whose
+// matrices are stored block by block
+static struct trace_buf* blocked_refs(void) {
+    struct trace_buf* b = new_buf((size_t) N * N * (2 * N + N / BLOCK));
+    int nb = N / BLOCK, bsq = BLOCK * BLOCK;
+    int ib, jb, kb, i, j, k;
+
+    for (ib = 0; ib < nb; ib++) {
+        for (jb = 0; jb < nb; jb++) {
+            for (kb = 0; kb < nb; kb++) {
+                int a = (ib * nb + kb) * bsq;
+                int bb = (kb * nb + jb) * bsq;
+                int c = (ib * nb + jb) * bsq;
+                for (i = 0; i < BLOCK; i++) {
+                    for (j = 0; j < BLOCK; j++) {
+                        for (k = 0; k < BLOCK; k++) {
+                            add_ref(b, 'L', A(a + i * BLOCK + k));
+                            add_ref(b, 'L', B(bb + k * BLOCK + j));
+                        }
+                        add_ref(b, 'M', C(c + i * BLOCK + j));
+                    }
+                }
+            }
+        }
+    }
+    return b;
+}
+
+/* Replays buf through a fresh instance of alg with memsize frames on
+ * nthreads threads. Returns the elapsed time in seconds.
+ */
+double run_replay(struct functions* alg, unsigned memsize,
+                  struct trace_buf* buf, int nthreads) {
+    struct sim sim;
+    double start, finish;
+
+    memset(&sim, 0, sizeof(sim));
+    sim.memsize = memsize;
+    sim.alg = alg;
+    sim.coremap = calloc(memsize, sizeof(struct frame));
+    sim.free_frames = malloc(memsize * sizeof(int));
+    for (sim.nfree = 0; sim.nfree < memsize; sim.nfree++) {
+        sim.free_frames[sim.nfree] = memsize - 1 - sim.nfree;
+    }
+    sim.physmem = malloc(memsize * SIMPAGESIZE);
+    sim.swap = swap_init(4096, swap_find_backend("mem"));
+    init_pagetable(&sim);
+    alg->init(&sim);
+
+    GET_TIME(start);
+    replay_concurrent(&sim, buf, nthreads);
+    GET_TIME(finish);
+
+    if (alg->destroy != NULL) {
+        alg->destroy(&sim);
+    }
+    swap_destroy(sim.swap);
+    destroy_pagetable(&sim);
+    free(sim.physmem);
+    free(sim.free_frames);
+    free(sim.coremap);
+    return finish - start;
+}
+
+int main(int argc, char* argv[]) {
+    int max_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    const char* names[] = {"matmul", "blocked"};
+    struct trace_buf* bufs[2];
+    // Pages the three matrices take up
+    unsigned pages = (unsigned) ((C(N * N) - A(0)) >> PAGE_SHIFT);
+    unsigned memsizes[] = {pages, pages / 10};
+    int t, i, j, m;
+
+    if (argc > 1) {
+        max_threads = (int) strtol(argv[1], NULL, 10);
+    }
+    if (max_threads < 1) {
+        max_threads = 1;
+    }
+    bufs[0] = matmul_refs();
+    bufs[1] = blocked_refs();
+
+    printf("%-8s %-6s %8s", "trace", "alg", "memsize");
+    for (t = 1; t <= max_threads; t++) {
+        printf(" %7d thr", t);
+    }
+    printf("   (M references/s, speedup; %zu references)\n", bufs[0]->nrefs);
+
+    for (i = 0; i < 2; i++) {
+        for (j = 0; j < num_policies; j++) {
+            for (m = 0; m < 2; m++) {
+                double base = 0;
+                printf("%-8s %-6s %8u", names[i], policies[j].name, memsizes[m]);
+                for (t = 1; t <= max_threads; t++) {
+                    double elapsed = run_replay(&policies[j], memsizes[m],
+                                                bufs[i], t);
+                    if (t == 1) {
+                        base = elapsed;
+                    }
+                    printf(" %5.1f %4.2fx", bufs[i]->nrefs / elapsed / 1e6,
+                           base / elapsed);
+                    fflush(stdout);
+                }
+                printf("\n");
+            }
+        }
+    }
+
+    free_buf(bufs[0]);
+    free_buf(bufs[1]);
+    return 0;
+}
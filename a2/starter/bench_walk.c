@@ -0,0 +1,129 @@
+/* File:     Page table walk microbenchmark
+ *
+ * Purpose:  Measure the cost of find_physpage() hits for each page table
+ *           layout (sim -L), so the extra levels needed for 48-bit traces
+ *           can be compared with the default 2-level table.
+ *
+ * Compile:  make bench_walk
+ * Run:      ./bench_walk [number of references per run]
+ *
+ * Output:   ns per reference and page table memory for every layout, with
+ *           the touched pages packed together or spread over the address
+ *           space.
+ *
+ * Notes:
+ * 1.  Every page fits in memory, so after the first touch each reference
+ *     is a hit and the time is all walk (plus the counter updates).
+ * 2.  Addresses stay below 2^36 so the 2-level layout can map them too.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+#include "pagetable.h"
+#include "traceprogs/timer.h"
+
+// Globals normally defined by sim.c
+int debug = 0;
+
+#define NPAGES  16384
+#define NSLOTS  (1 << 20)  // Precomputed references, reused round robin
+
+void noop_init(struct sim* s) {
+}
+
+void noop_ref(struct sim* s, pgtbl_entry_t* p) {
+}
+
+int noop_evict(struct sim* s) {
+    fprintf(stderr, "bench_walk: unexpected eviction\n");
+    exit(1);
+}
+
+struct functions noop = {"noop", noop_init, noop_ref, noop_evict};
+
+int levels[] = {2, 3, 4};
+int num_levels = sizeof(levels) / sizeof(levels[0]);
+
+/* Touches every page in pages[], then replays nrefs references to them in
+ * the order given by refs[] through a page table with the given number of
+ * levels. Returns the elapsed time for the replay in seconds, and the page
+ * table memory in *bytes.
+ */
+double run_walk(int nlevels, addr_t* pages, unsigned* refs, long nrefs,
+                unsigned long* bytes) {
+    struct sim sim;
+    double start, finish;
+    long i;
+
+    memset(&sim, 0, sizeof(sim));
+    sim.memsize = NPAGES;
+    sim.alg = &noop;
+    sim.coremap = calloc(NPAGES, sizeof(struct frame));
+    sim.free_frames = malloc(NPAGES * sizeof(int));
+    for (sim.nfree = 0; sim.nfree < NPAGES; sim.nfree++) {
+        sim.free_frames[sim.nfree] = NPAGES - 1 - sim.nfree;
+    }
+    sim.physmem = malloc(NPAGES * SIMPAGESIZE);
+    pgtbl_levels = nlevels;
+    init_pagetable(&sim);
+
+    for (i = 0; i < NPAGES; i++) {
+        find_physpage(&sim, pages[i], 'L');
+    }
+
+    GET_TIME(start);
+    for (i = 0; i < nrefs; i++) {
+        find_physpage(&sim, pages[refs[i & (NSLOTS - 1)]], 'L');
+    }
+    GET_TIME(finish);
+
+    *bytes = sim.pgtbl_bytes;
+    destroy_pagetable(&sim);
+    free(sim.physmem);
+    free(sim.free_frames);
+    free(sim.coremap);
+    return finish - start;
+}
+
+int main(int argc, char* argv[]) {
+    long nrefs = 10000000;
+    addr_t* dense = malloc(NPAGES * sizeof(addr_t));
+    addr_t* sparse = malloc(NPAGES * sizeof(addr_t));
+    unsigned* refs = malloc(NSLOTS * sizeof(unsigned));
+    unsigned long bytes;
+    int i, j;
+
+    if (argc > 1) {
+        nrefs = strtol(argv[1], NULL, 10);
+    }
+
+    // Sparse pages may repeat, which just makes them hit one more time
+    srandom(1);
+    for (i = 0; i < NPAGES; i++) {
+        dense[i] = 0x400000 + ((addr_t) i << PAGE_SHIFT);
+        sparse[i] = ((((addr_t) random() << 31) | random()) &
+                     ((1UL << VADDR_BITS) - 1)) & PAGE_MASK;
+    }
+    for (i = 0; i < NSLOTS; i++) {
+        refs[i] = random() % NPAGES;
+    }
+
+    printf("%-10s", "pages");
+    for (j = 0; j < num_levels; j++) {
+        printf("%9d-level %8s", levels[j], "KB");
+    }
+    printf("   (ns per reference, %ld references)\n", nrefs);
+
+    for (i = 0; i < 2; i++) {
+        printf("%-10s", i == 0 ? "dense" : "sparse");
+        for (j = 0; j < num_levels; j++) {
+            double elapsed = run_walk(levels[j], i == 0 ? dense : sparse,
+                                      refs, nrefs, &bytes);
+            printf("%15.1f %8lu", elapsed * 1e9 / nrefs, bytes / 1024);
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -3,44 +3,47 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <stdlib.h>
+#include "sim.h"
 #include "pagetable.h"
 
 
-extern int memsize;
-
 extern int debug;
 
-extern struct frame *coremap;
-
-int clock_arm;
+// s->alg_data points at the clock arm: the frame it is currently on
 
 /* Page to evict is chosen using the clock algorithm.
  * Returns the page frame number (which is also the index in the coremap)
  * for the page that is to be evicted.
  */
 
-int is_referenced() {
-    return coremap[clock_arm].pte->frame & PG_REF;
+int is_referenced(struct sim *s, int clock_arm) {
+    return pte_test(s->coremap[clock_arm].pte, PG_REF);
 }
 
-void turn_off_reference() {
-    coremap[clock_arm].pte->frame &= ~PG_REF;
+void turn_off_reference(struct sim *s, int clock_arm) {
+    // Other threads may be setting REF or DIRTY on it (sim -c)
+    if (s->concurrent) {
+        pte_clear_atomic(s->coremap[clock_arm].pte, PG_REF);
+    } else {
+        pte_clear(s->coremap[clock_arm].pte, PG_REF);
+    }
 }
 
-void sweep_clock_arm(){
-    clock_arm = (clock_arm + 1) % memsize;
+void sweep_clock_arm(struct sim *s, int *clock_arm){
+    *clock_arm = (*clock_arm + 1) % s->memsize;
 }
 
-int clock_evict() {
+int clock_evict(struct sim *s) {
+    int *clock_arm = s->alg_data;
 
-    while (is_referenced()) {
-        turn_off_reference();
+    while (is_referenced(s, *clock_arm)) {
+        turn_off_reference(s, *clock_arm);
         // move clock_arm in clock wised direction after turning off current frame's ref bit
-        sweep_clock_arm();
+        sweep_clock_arm(s, clock_arm);
     }
     // evict current frame, advance to next frame
-    int current_frame = clock_arm;
-    sweep_clock_arm();
+    int current_frame = *clock_arm;
+    sweep_clock_arm(s, clock_arm);
 
 	return current_frame;
 }
@@ -51,7 +54,7 @@ int clock_evict() {
  * needed by the clock algorithm.
  * Input: The page table entry for the page that is being accessed.
  */
-void clock_ref(pgtbl_entry_t *p) {
+void clock_ref(struct sim *s, pgtbl_entry_t *p) {
     // Don't need to do anything here,
     // R is the only thing that needs to be updated for clock,
     // and it's already updated when we reference a page
@@ -61,7 +64,9 @@ void clock_ref(pgtbl_entry_t *p) {
 /* Initialize any data structures needed for this replacement
  * algorithm. 
  */
-void clock_init() {
+void clock_init(struct sim *s) {
 	// start the clock by pointing to 0th frame
-	clock_arm = 0;
+	int *clock_arm = malloc(sizeof(int));
+	*clock_arm = 0;
+	s->alg_data = clock_arm;
 }
@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <assert.h>
+#include <stdlib.h>
+#include "sim.h"
+#include "pagetable.h"
+#include "pagemap.h"
+
+extern int debug;
+
+//region DESCRIPTION OF CLOCK-PRO IMPLEMENTATION
+
+/*
+ * CLOCK-Pro (Jiang, Chen and Zhang, USENIX '05). Pages are hot or cold.
+ * A new page starts out cold and "in its test period"; if it is referenced
+ * again before the test ends it has a small reuse distance and becomes
+ * hot. Evicted cold pages that are still being tested stay on the clock
+ * without a frame (non-resident), so a fault on one also promotes it.
+ *
+ * All pages sit on one circular list, newest just behind hand_hot, swept by
+ * three hands in the same direction:
+ *      hand_cold - finds a cold resident page to evict, giving referenced
+ *                  ones a new test period (or making them hot if tested)
+ *      hand_hot  - demotes an unreferenced hot page to cold when there are
+ *                  more hot pages than memsize - cold_target, ending the
+ *                  test periods of the cold pages it passes
+ *      hand_test - ends test periods when more than memsize pages are
+ *                  non-resident, dropping the non-resident ones
+ * cold_target adapts: a fault on a non-resident page in its test period
+ * raises it, and a test period that ends without a reuse lowers it.
+ *
+ * The list is a PageMap, so moves are O(1), and every hand step either
+ * clears a reference bit, changes a page's state or drops a page, so the
+ * sweeps are O(1) amortized per reference. PG_REF in the page table is not
+ * used; references are recorded in the node by clockpro_ref().
+ * */
+
+//endregion
+
+#define CLOCK   0
+
+#define HOT     0x1
+#define TEST    0x2
+#define REF     0x4
+
+// Each instance's s->alg_data
+typedef struct {
+    PageMap* map;
+    int hand_hot, hand_cold, hand_test;
+    int nhot;           // Resident hot pages
+    int nnonres;        // Non-resident cold pages in their test period
+    int cold_target;    // Frames for cold pages, in [1, memsize - 1]
+} ClockPro;
+
+static int max_cold(struct sim* s) {
+    return s->memsize > 1 ? (int) s->memsize - 1 : 1;
+}
+
+// Puts node at the head of the clock, just behind hand_hot
+static void to_head(ClockPro* c, int node) {
+    if (c->hand_hot == PM_NONE) {
+        c->hand_hot = c->hand_cold = c->hand_test = node;
+        return;
+    }
+    // Already just behind hand_hot once the hand steps past it
+    if (c->hand_hot == node) {
+        c->hand_hot = pagemap_next(c->map, node);
+    }
+    pagemap_move_before(c->map, node, c->hand_hot);
+}
+
+// Drops node from the clock, moving any hand on it along first
+static void drop(ClockPro* c, int node) {
+    int next = pagemap_next(c->map, node);
+    if (next == node) {
+        next = PM_NONE;
+    }
+    if (c->hand_hot == node) {
+        c->hand_hot = next;
+    }
+    if (c->hand_cold == node) {
+        c->hand_cold = next;
+    }
+    if (c->hand_test == node) {
+        c->hand_test = next;
+    }
+    pagemap_remove(c->map, node);
+}
+
+// Ends node's test period; a non-resident page is dropped with it
+static void end_test(ClockPro* c, int node) {
+    PageNode* n = &c->map->nodes[node];
+    n->flags &= ~TEST;
+    if (c->cold_target > 1) {
+        c->cold_target--;
+    }
+    if (n->frame == PM_NONE) {
+        c->nnonres--;
+        drop(c, node);
+    }
+}
+
+static void run_hand_test(ClockPro* c) {
+    while (c->nnonres > 0) {
+        int node = c->hand_test;
+        PageNode* n = &c->map->nodes[node];
+        int dropped = n->frame == PM_NONE;
+
+        c->hand_test = pagemap_next(c->map, node);
+        if (!(n->flags & HOT) && (n->flags & TEST)) {
+            end_test(c, node);
+            if (dropped) {
+                return;
+            }
+        }
+    }
+}
+
+static void run_hand_hot(ClockPro* c) {
+    for (;;) {
+        int node = c->hand_hot;
+        PageNode* n = &c->map->nodes[node];
+
+        c->hand_hot = pagemap_next(c->map, node);
+        if (n->flags & HOT) {
+            if (n->flags & REF) {
+                n->flags &= ~REF;
+            } else {
+                n->flags &= ~HOT;
+                c->nhot--;
+                return;
+            }
+        } else if (n->flags & TEST) {
+            end_test(c, node);
+        }
+    }
+}
+
+static void make_hot(struct sim* s, ClockPro* c, int node) {
+    c->map->nodes[node].flags = HOT;
+    c->nhot++;
+    to_head(c, node);
+    while (c->nhot > (int) s->memsize - c->cold_target) {
+        run_hand_hot(c);
+    }
+}
+
+int clockpro_evict(struct sim* s) {
+    ClockPro* c = s->alg_data;
+
+    for (;;) {
+        int node = c->hand_cold;
+        PageNode* n = &c->map->nodes[node];
+        int next = pagemap_next(c->map, node);
+
+        if ((n->flags & HOT) || n->frame == PM_NONE) {
+            c->hand_cold = next;
+            continue;
+        }
+
+        if (n->flags & REF) {
+            // Referenced since the hand last passed: keep it
+            c->hand_cold = next;
+            if (n->flags & TEST) {
+                make_hot(s, c, node);
+            } else {
+                n->flags = TEST;
+                to_head(c, node);
+            }
+            continue;
+        }
+
+        int frame = n->frame;
+        if (n->flags & TEST) {
+            // Keep testing it without a frame
+            c->hand_cold = next;
+            n->frame = PM_NONE;
+            c->nnonres++;
+            while (c->nnonres > (int) s->memsize) {
+                run_hand_test(c);
+            }
+        } else {
+            drop(c, node);
+        }
+        return frame;
+    }
+}
+
+void clockpro_ref(struct sim* s, pgtbl_entry_t* p) {
+    ClockPro* c = s->alg_data;
+    int node = pagemap_find(c->map, p);
+
+    if (node == PM_NONE) {
+        node = pagemap_add(c->map, p, (int) pte_frame(p), CLOCK);
+        c->map->nodes[node].flags = TEST;
+        to_head(c, node);
+    } else if (c->map->nodes[node].frame == PM_NONE) {
+        // Faulted back in during its test period: cold pages need more room
+        if (c->cold_target < max_cold(s)) {
+            c->cold_target++;
+        }
+        c->map->nodes[node].frame = (int) pte_frame(p);
+        c->nnonres--;
+        make_hot(s, c, node);
+    } else {
+        c->map->nodes[node].flags |= REF;
+    }
+}
+
+void clockpro_init(struct sim* s) {
+    ClockPro* c = malloc(sizeof(ClockPro));
+    c->map = pagemap_create(1, 2 * s->memsize + 1);
+    c->hand_hot = c->hand_cold = c->hand_test = PM_NONE;
+    c->nhot = 0;
+    c->nnonres = 0;
+    c->cold_target = 1;
+    s->alg_data = c;
+}
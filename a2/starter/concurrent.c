@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "sim.h"
+#include "pagetable.h"
+#include "concurrent.h"
+
+//region DESCRIPTION OF CONCURRENT REPLAY
+
+/*
+ * Threads claim CHUNK references at a time with a fetch-and-add on the
+ * index of the next unclaimed one, so handing out work takes no lock.
+ *
+ * Everything that changes what is resident happens under the pool's fault
+ * lock: find_physpage() allocating frames, evicting, reading swap and
+ * running the replacement algorithm, just as in a single-threaded replay.
+ * The lock-free path only reads the page table, sets REF and DIRTY with
+ * atomic ORs, and pins the frame it reads; see pin_physpage() and
+ * evict_page() for how that keeps a page from leaving mid-read.
+ *
+ * s->proc and s->pgdir belong to whichever thread holds the lock, so each
+ * thread remembers its own process and sets them again when it takes it.
+ * A thread's lock-free hits are counted against its process, and added to
+ * that process' and the instance's counters when it next takes the lock
+ * to change process, or when it runs out of references.
+ * */
+
+//endregion
+
+#define CHUNK 1024
+
+struct pool {
+    struct sim* s;
+    struct trace_buf* buf;
+    size_t next;                // First reference not yet claimed
+    pthread_mutex_t lock;       // The fault lock
+};
+
+struct replayer {
+    struct pool* pool;
+    struct proc* proc;          // Process of this thread's last reference
+    int hit_count;              // Lock-free hits in proc not yet counted
+    pthread_t thread;
+};
+
+/* Algorithms whose ref_fcn does nothing learn about hits from PG_REF
+ * alone, so theirs can skip the lock.
+ */
+int replay_concurrent_supported(struct functions* alg) {
+    return alg->on_hit == NULL &&
+           (alg->ref == clock_ref || alg->ref == rand_ref ||
+            alg->ref == aging_ref);
+}
+
+// Checks the page holds what it should, and bumps its version on a write
+static void touch_mem(char* memptr, char type, addr_t vaddr) {
+    addr_t* checkaddr = (addr_t*) (memptr + sizeof(int));
+
+    if (*checkaddr != vaddr) {
+        fprintf(stderr, "Error, simulated page returned by pagetable lookup doese not have expected value.\n");
+    }
+    if (type == 'S' || type == 'M') {
+        __atomic_fetch_add((int*) memptr, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Adds r's lock-free hits to the counters. Called with the lock held.
+static void count_hits(struct replayer* r) {
+    struct sim* s = r->pool->s;
+
+    if (r->hit_count != 0) {
+        s->hit_count += r->hit_count;
+        s->ref_count += r->hit_count;
+        r->proc->hit_count += r->hit_count;
+        r->proc->ref_count += r->hit_count;
+        r->hit_count = 0;
+    }
+}
+
+static void access_locked(struct replayer* r, char type, addr_t vaddr,
+                          unsigned pid) {
+    struct sim* s = r->pool->s;
+
+    pthread_mutex_lock(&r->pool->lock);
+    if (r->proc != NULL && r->proc->pid == pid) {
+        s->proc = r->proc;
+        s->pgdir = r->proc->pgdir;
+    } else {
+        if (r->proc != NULL) {
+            count_hits(r);
+        }
+        switch_process(s, pid);
+        r->proc = s->proc;
+    }
+    touch_mem(find_physpage(s, vaddr, type), type, vaddr);
+    pthread_mutex_unlock(&r->pool->lock);
+}
+
+static void* replay_worker(void* arg) {
+    struct replayer* r = arg;
+    struct pool* pool = r->pool;
+    struct trace_buf* b = pool->buf;
+    struct sim* s = pool->s;
+    size_t i, start, end;
+    int frame;
+
+    while ((start = __atomic_fetch_add(&pool->next, CHUNK,
+                                       __ATOMIC_RELAXED)) < b->nrefs) {
+        end = start + CHUNK < b->nrefs ? start + CHUNK : b->nrefs;
+        for (i = start; i < end; i++) {
+            char type = b->types[i];
+            addr_t vaddr = b->vaddrs[i];
+            unsigned pid = b->pids[i];
+
+            if (r->proc != NULL && r->proc->pid == pid &&
+                (frame = pin_physpage(s, r->proc->pgdir, vaddr, type)) != -1) {
+                touch_mem(&s->physmem[frame * SIMPAGESIZE], type, vaddr);
+                unpin_frame(s, frame);
+                r->hit_count++;
+            } else {
+                access_locked(r, type, vaddr, pid);
+            }
+        }
+    }
+
+    if (r->proc != NULL) {
+        pthread_mutex_lock(&pool->lock);
+        count_hits(r);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return NULL;
+}
+
+void replay_concurrent(struct sim* s, struct trace_buf* buf, int nthreads) {
+    struct replayer* replayers = calloc(nthreads, sizeof(struct replayer));
+    struct pool pool;
+    int i;
+
+    pool.s = s;
+    pool.buf = buf;
+    pool.next = 0;
+    pthread_mutex_init(&pool.lock, NULL);
+    s->concurrent = 1;
+
+    for (i = 0; i < nthreads; i++) {
+        replayers[i].pool = &pool;
+        if (pthread_create(&replayers[i].thread, NULL, replay_worker,
+                           &replayers[i]) != 0) {
+            perror("Failed to create replay thread");
+            exit(1);
+        }
+    }
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(replayers[i].thread, NULL);
+    }
+
+    s->concurrent = 0;
+    pthread_mutex_destroy(&pool.lock);
+    free(replayers);
+}
@@ -0,0 +1,28 @@
+#ifndef __CONCURRENT_H__
+#define __CONCURRENT_H__
+
+#include "sim.h"
+
+/* Concurrent replay (-c threads).
+ *
+ * A pool of threads replays one instance's references together, taking
+ * chunks of the trace in turn, as the threads of a program would share its
+ * memory. Hits on resident pages go through pin_physpage() without locking,
+ * so only replacement algorithms that see hits through PG_REF alone (clock,
+ * rand, aging) are supported; faults take the instance's fault lock and go
+ * through find_physpage(). The others would need every reference under the
+ * lock, which is no faster than replaying on one thread.
+ *
+ * Counters are kept per thread and added to the instance's (and its
+ * processes') under the lock. The order references from different threads
+ * reach the page table varies, so results can differ from run to run.
+ */
+
+// Whether alg can be replayed concurrently
+extern int replay_concurrent_supported(struct functions *alg);
+
+// Replays every reference in buf through s on nthreads threads
+extern void replay_concurrent(struct sim *s, struct trace_buf *buf,
+                              int nthreads);
+
+#endif // __CONCURRENT_H__
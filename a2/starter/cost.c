@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cost.h"
+
+struct cost_model *cost_model = NULL;
+
+/* Defaults are rough figures for a DRAM access, a 4-level page walk that
+ * mostly hits in cache, a zero-fill fault, and 4KB reads and writes on an
+ * SSD. Evicting a clean page only costs the unmap and shootdown.
+ */
+static struct cost_model model = {
+		.hit_ns = 100,
+		.tlb_miss_ns = 30,
+		.minor_ns = 2000,
+		.major_ns = 100000,
+		.evict_clean_ns = 500,
+		.evict_dirty_ns = 100000,
+};
+
+int cost_parse(char *spec) {
+	static const struct {
+		const char *name;
+		size_t offset;
+	} latencies[] = {
+		{"hit", offsetof(struct cost_model, hit_ns)},
+		{"tlb", offsetof(struct cost_model, tlb_miss_ns)},
+		{"minor", offsetof(struct cost_model, minor_ns)},
+		{"major", offsetof(struct cost_model, major_ns)},
+		{"clean", offsetof(struct cost_model, evict_clean_ns)},
+		{"dirty", offsetof(struct cost_model, evict_dirty_ns)},
+	};
+	char *tok = spec, *end;
+	size_t i;
+
+	cost_model = &model;
+	if (strcmp(spec, "default") == 0) {
+		return 0;
+	}
+	for (;;) {
+		for (i = 0; i < sizeof(latencies) / sizeof(latencies[0]); i++) {
+			size_t len = strlen(latencies[i].name);
+			if (strncmp(tok, latencies[i].name, len) == 0 && tok[len] == '=') {
+				break;
+			}
+		}
+		if (i == sizeof(latencies) / sizeof(latencies[0])) {
+			return -1;
+		}
+		tok = strchr(tok, '=') + 1;
+		unsigned long ns = strtoul(tok, &end, 10);
+		if (end == tok || (*end != ',' && *end != '\0')) {
+			return -1;
+		}
+		*(unsigned long *)((char *)&model + latencies[i].offset) = ns;
+		if (*end == '\0') {
+			return 0;
+		}
+		tok = end + 1;
+	}
+}
+
+void cost_print(struct cost *c, int refs) {
+	int i;
+
+	printf("Simulated time: %.3f ms\n", c->total_ns / 1e6);
+	printf("AMAT: %.1f ns\n", refs ? (double)c->total_ns / refs : 0.0);
+	printf("Mean fault latency: %.1f ns\n",
+	       c->faults ? (double)c->fault_ns / c->faults : 0.0);
+	printf("Fault latency histogram (ns):\n");
+	for (i = 0; i < COST_BUCKETS; i++) {
+		if (c->hist[i] != 0) {
+			printf("  [%lu, %lu): %lu\n", 1UL << i,
+			       i < 63 ? 1UL << (i + 1) : ~0UL, c->hist[i]);
+		}
+	}
+}
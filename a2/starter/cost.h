@@ -0,0 +1,79 @@
+#ifndef __COST_H__
+#define __COST_H__
+
+/* Latency cost model (-C).
+ *
+ * Every reference costs hit_ns, plus tlb_miss_ns when there is a TLB (-T)
+ * and it misses. A fault adds minor_ns if the page is new (a zero-filled
+ * frame, or a huge page promotion) or major_ns if it comes back from swap,
+ * plus evict_clean_ns or evict_dirty_ns when a page had to be evicted to
+ * make room. Each instance adds these up as it replays its trace, giving
+ * the simulated time spent in memory accesses and a histogram of how long
+ * faults took.
+ */
+struct cost_model {
+	unsigned long hit_ns;
+	unsigned long tlb_miss_ns;
+	unsigned long minor_ns;
+	unsigned long major_ns;
+	unsigned long evict_clean_ns;
+	unsigned long evict_dirty_ns;
+};
+
+// The model in use, or NULL if costs aren't being modelled
+extern struct cost_model *cost_model;
+
+// Power-of-two buckets of fault latency: bucket i counts [2^i, 2^(i+1)) ns
+#define COST_BUCKETS 64
+
+// Each instance's accumulated cost
+struct cost {
+	unsigned long long total_ns;
+	unsigned long long fault_ns;
+	unsigned long faults;
+	unsigned long hist[COST_BUCKETS];
+	unsigned long ref_ns;       // Cost so far of the reference being replayed
+};
+
+// Starts costing a reference, which walked the page table if tlb_miss
+static inline void cost_begin(struct cost *c, int tlb_miss) {
+	if (cost_model != NULL) {
+		c->ref_ns = cost_model->hit_ns + (tlb_miss ? cost_model->tlb_miss_ns : 0);
+	}
+}
+
+static inline void cost_fault(struct cost *c, int major) {
+	if (cost_model != NULL) {
+		c->ref_ns += major ? cost_model->major_ns : cost_model->minor_ns;
+	}
+}
+
+static inline void cost_evict(struct cost *c, int dirty) {
+	if (cost_model != NULL) {
+		c->ref_ns += dirty ? cost_model->evict_dirty_ns : cost_model->evict_clean_ns;
+	}
+}
+
+// Adds the reference's cost to the totals, and to the histogram if it faulted
+static inline void cost_end(struct cost *c, int fault) {
+	if (cost_model != NULL) {
+		c->total_ns += c->ref_ns;
+		if (fault) {
+			c->faults++;
+			c->fault_ns += c->ref_ns;
+			c->hist[63 - __builtin_clzl(c->ref_ns | 1)]++;
+		}
+	}
+}
+
+/* Sets cost_model from "default" or a comma-separated list of name=ns
+ * pairs (hit, tlb, minor, major, clean, dirty), each overriding the
+ * default for that latency. Returns 0 on success, -1 if the spec is
+ * malformed.
+ */
+extern int cost_parse(char *spec);
+
+// Prints the simulated time, AMAT and fault latency histogram for c
+extern void cost_print(struct cost *c, int refs);
+
+#endif // __COST_H__
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "evlog.h"
+
+// Writes all len bytes of buf to fd, exiting on failure
+static void write_all(int fd, const void* buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            perror("Error writing event log");
+            exit(1);
+        }
+        buf = (const char*) buf + n;
+        len -= (size_t) n;
+    }
+}
+
+/* Drains the ring to the file until evlog_close() says to stop, sleeping
+ * while no batch is waiting. Whatever is between tail and head is
+ * written straight from the ring with one write, or two if it wraps around
+ * the end of the ring.
+ */
+static void* evlog_flush(void* arg) {
+    struct evlog* l = arg;
+
+    while (1) {
+        unsigned long tail = l->tail;
+        unsigned long head;
+        int done;
+
+        pthread_mutex_lock(&l->lock);
+        while (!(done = l->done) &&
+               __atomic_load_n(&l->published, __ATOMIC_ACQUIRE) == tail) {
+            pthread_cond_wait(&l->wake, &l->lock);
+        }
+        pthread_mutex_unlock(&l->lock);
+
+        // Read after done, so events put before it was set are seen
+        head = __atomic_load_n(&l->published, __ATOMIC_ACQUIRE);
+        if (head == tail && done) {
+            return NULL;
+        }
+        while (tail != head) {
+            unsigned long start = tail & (EVLOG_RING - 1);
+            unsigned long n = head - tail;
+            if (n > EVLOG_RING - start) {
+                n = EVLOG_RING - start;
+            }
+            write_all(l->fd, &l->ring[start], n * sizeof(uint32_t));
+            tail += n;
+            __atomic_store_n(&l->tail, tail, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+struct evlog* evlog_open(const char* path, unsigned sample) {
+    struct evlog_header header;
+    struct evlog* l;
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0) {
+        return NULL;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, EVLOG_MAGIC, EVLOG_MAGIC_LEN);
+    header.version = EVLOG_VERSION;
+    header.word_size = sizeof(uint32_t);
+    header.sample = sample;
+    if (write(fd, &header, sizeof(header)) != sizeof(header)) {
+        close(fd);
+        return NULL;
+    }
+
+    if (posix_memalign((void**) &l, 64, sizeof(struct evlog)) != 0) {
+        perror("Failed to allocate event log");
+        exit(1);
+    }
+    memset(l, 0, sizeof(struct evlog));
+    l->ring = malloc(EVLOG_RING * sizeof(uint32_t));
+    l->fd = fd;
+    l->sample_below = UINT64_MAX / sample;
+    pthread_mutex_init(&l->lock, NULL);
+    pthread_cond_init(&l->wake, NULL);
+    if (pthread_create(&l->flusher, NULL, evlog_flush, l) != 0) {
+        perror("Failed to create event log thread");
+        exit(1);
+    }
+    return l;
+}
+
+void evlog_close(struct evlog* l) {
+    pthread_mutex_lock(&l->lock);
+    __atomic_store_n(&l->published, l->head, __ATOMIC_RELEASE);
+    l->done = 1;
+    pthread_cond_signal(&l->wake);
+    pthread_mutex_unlock(&l->lock);
+    pthread_join(l->flusher, NULL);
+    if (close(l->fd) != 0) {
+        perror("Error writing event log");
+        exit(1);
+    }
+    pthread_cond_destroy(&l->wake);
+    pthread_mutex_destroy(&l->lock);
+    free(l->ring);
+    free(l);
+}
+
+void evlog_submit(struct evlog* l) {
+    pthread_mutex_lock(&l->lock);
+    __atomic_store_n(&l->published, l->head, __ATOMIC_RELEASE);
+    pthread_cond_signal(&l->wake);
+    pthread_mutex_unlock(&l->lock);
+
+    // The ring has room for the next batch once the flusher has written out
+    // all but the last EVLOG_RING - EVLOG_BATCH words
+    while (l->head - __atomic_load_n(&l->tail, __ATOMIC_ACQUIRE) >
+           EVLOG_RING - EVLOG_BATCH) {
+        sched_yield();
+    }
+}
@@ -0,0 +1,133 @@
+#ifndef __EVLOG_H__
+#define __EVLOG_H__
+
+#include <stdint.h>
+#include <pthread.h>
+
+/* Binary event log (-E file).
+ *
+ * An instance with a log records every hit and miss, every eviction and
+ * every page read from or written to swap, each with the page (as given by
+ * trace_page()) and frame involved. Events go into a ring buffer that a
+ * background thread drains to the file, so the replay only waits for the
+ * disk when the ring fills. evsum summarizes a log.
+ *
+ * The file is a struct evlog_header followed by 32-bit words, in the byte
+ * order of the machine that wrote it. Most events are hits on a page the
+ * log has already seen go into its frame, so a hit is just that frame
+ * number, which is below EV_TAG. Every other event, and the first hit on a
+ * prefetched page or any hit on a huge page, is EV_TAG | type followed by
+ * the frame and the low and high halves of the page. A reader learns which
+ * page each frame holds from the misses and swap-ins.
+ *
+ * Each reference logs exactly one hit or miss, after any other events it
+ * caused, so the index of the reference an event belongs to is not stored:
+ * it is the number of hits and misses before it.
+ *
+ * A log can instead be limited to the events of 1 in N pages, picked by a
+ * hash of the page number, so each page it has is logged in full. Its
+ * times and distances then count only the sampled pages' references, and
+ * scaling them (and the counts) by N estimates those of the whole run.
+ */
+#define EVLOG_MAGIC      "SIMEVT\0"
+#define EVLOG_MAGIC_LEN  8
+#define EVLOG_VERSION    3
+
+#define EV_HIT           0
+#define EV_MISS          1
+#define EV_EVICT_CLEAN   2
+#define EV_EVICT_DIRTY   3
+#define EV_SWAP_IN       4
+#define EV_SWAP_OUT      5
+#define EV_TYPES         6
+
+// Marks the first word of an event other than a hit by frame number
+#define EV_TAG           0xf0000000u
+
+// Frame of a hit or miss served by a huge page (-H)
+#define EV_NO_FRAME      0xffffffffu
+
+struct evlog_header {
+    char magic[EVLOG_MAGIC_LEN];
+    uint32_t version;
+    uint32_t word_size;     // sizeof(uint32_t)
+    uint32_t sample;        // Pages logged are 1 in this many
+    uint32_t unused;
+};
+
+// An event as a reader decodes it
+struct event {
+    uint64_t page;          // trace_page() of the page
+    uint32_t frame;
+    uint32_t type;          // EV_*
+};
+
+// Words the ring holds, and how many are put between wakeups of the
+// flusher; both powers of two
+#define EVLOG_RING  (1 << 19)
+#define EVLOG_BATCH (EVLOG_RING / 4)
+
+/* The ring has a single producer, the thread replaying the instance, and a
+ * single consumer, the flusher, so each end only writes its own index. The
+ * producer hands words over a batch at a time: when head reaches the end of
+ * a batch it publishes it with a release store, wakes the flusher and waits
+ * until the ring has room for the whole next batch, so putting a word in
+ * between is just a store. The indices sit on separate cache lines so the
+ * two threads don't keep taking the line from each other.
+ */
+struct evlog {
+    uint32_t* ring;
+    int fd;
+    uint64_t sample_below;      // Pages whose hash is at most this are logged
+    unsigned long head;         // Words put, only used by the producer
+    pthread_t flusher;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+
+    unsigned long published __attribute__((aligned(64)));  // Words handed over
+
+    unsigned long tail __attribute__((aligned(64)));  // Words written out
+    int done;                   // Set once no more events will be put
+};
+
+// Creates path and starts its flusher, to log 1 in sample pages; NULL
+// (with errno set) on failure
+extern struct evlog* evlog_open(const char* path, unsigned sample);
+
+// Writes out the rest of the events, stops the flusher and closes the file
+extern void evlog_close(struct evlog* l);
+
+// Hands the batch just put to the flusher, and waits for room for the next
+extern void evlog_submit(struct evlog* l);
+
+// Whether page's events go in the log. Inlined even without optimization,
+// like evlog_put(), as it runs on every reference.
+static inline __attribute__((always_inline))
+int evlog_sampled(struct evlog* l, uint64_t page) {
+    return page * 0x9E3779B97F4A7C15ull <= l->sample_below;
+}
+
+static inline __attribute__((always_inline))
+void evlog_put_word(struct evlog* l, uint32_t word) {
+    l->ring[l->head & (EVLOG_RING - 1)] = word;
+    if ((++l->head & (EVLOG_BATCH - 1)) == 0) {
+        evlog_submit(l);
+    }
+}
+
+static inline __attribute__((always_inline))
+void evlog_put(struct evlog* l, unsigned type, uint64_t page,
+               unsigned frame) {
+    evlog_put_word(l, EV_TAG | type);
+    evlog_put_word(l, frame);
+    evlog_put_word(l, (uint32_t) page);
+    evlog_put_word(l, (uint32_t) (page >> 32));
+}
+
+// Logs a hit on the page the log last saw go into frame
+static inline __attribute__((always_inline))
+void evlog_put_hit(struct evlog* l, unsigned frame) {
+    evlog_put_word(l, frame);
+}
+
+#endif // __EVLOG_H__
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "evlog.h"
+#include "mrc.h"
+
+// Globals normally defined by sim.c, used by mrc.c and opt.c
+char* tracefile = NULL;
+unsigned opt_window = 0;
+
+static const char* event_names[EV_TYPES] = {
+        "hit", "miss", "evict clean", "evict dirty", "swap in", "swap out"
+};
+
+// Power-of-two buckets: bucket i counts [2^i, 2^(i+1)), bucket 0 also 0
+#define BUCKETS 64
+
+static int bucket(unsigned long x) {
+    return 63 - __builtin_clzl(x | 1);
+}
+
+static void print_hist(const char* title, unsigned long* hist) {
+    int i;
+
+    printf("%s:\n", title);
+    for (i = 0; i < BUCKETS; i++) {
+        if (hist[i] != 0) {
+            printf("  [%lu, %lu): %lu\n", i == 0 ? 0 : 1UL << i,
+                   i < 63 ? 1UL << (i + 1) : ~0UL, hist[i]);
+        }
+    }
+}
+
+// What is known about a page, found by open addressing on page + 1
+typedef struct {
+    uint64_t key;           // page + 1, or 0 if the slot is empty
+    uint64_t last_ref;      // Time of its latest reference
+    uint64_t faulted;       // Time of the miss that last brought it in
+    int referenced;         // Whether it was referenced since it came in
+    int has_faulted;        // Whether faulted is set
+} PageInfo;
+
+typedef struct {
+    PageInfo* slots;
+    size_t capacity;        // Always a power of two
+    size_t count;
+} PageTable;
+
+static PageInfo* page_slot(PageInfo* slots, size_t capacity, uint64_t page) {
+    size_t mask = capacity - 1;
+    size_t i = (size_t) (page * 0x9E3779B97F4A7C15ull >> 20) & mask;
+    while (slots[i].key != 0 && slots[i].key != page + 1) {
+        i = (i + 1) & mask;
+    }
+    return &slots[i];
+}
+
+static PageInfo* page_info(PageTable* t, uint64_t page) {
+    PageInfo* p;
+    size_t i;
+
+    if (2 * (t->count + 1) > t->capacity) {
+        PageInfo* old = t->slots;
+        size_t old_capacity = t->capacity;
+        t->capacity = old_capacity ? 2 * old_capacity : 1024;
+        t->slots = calloc(t->capacity, sizeof(PageInfo));
+        for (i = 0; i < old_capacity; i++) {
+            if (old[i].key != 0) {
+                *page_slot(t->slots, t->capacity, old[i].key - 1) = old[i];
+            }
+        }
+        free(old);
+    }
+    p = page_slot(t->slots, t->capacity, page);
+    if (p->key == 0) {
+        p->key = page + 1;
+        t->count++;
+    }
+    return p;
+}
+
+// The page each frame holds, as page + 1 so that 0 means none seen yet
+typedef struct {
+    uint64_t* pages;
+    size_t size;
+} FrameMap;
+
+static void frame_bind(FrameMap* m, uint32_t frame, uint64_t page) {
+    if (frame >= m->size) {
+        size_t old_size = m->size;
+        while (m->size <= frame) {
+            m->size = m->size ? 2 * m->size : 1024;
+        }
+        m->pages = realloc(m->pages, m->size * sizeof(uint64_t));
+        memset(&m->pages[old_size], 0, (m->size - old_size) * sizeof(uint64_t));
+    }
+    m->pages[frame] = page + 1;
+}
+
+static uint32_t read_word(FILE* fp) {
+    uint32_t w;
+    if (fread(&w, sizeof(w), 1, fp) != 1) {
+        fprintf(stderr, "Error: event log ends in the middle of an event\n");
+        exit(1);
+    }
+    return w;
+}
+
+/* Reads the next event into e, returning 0 at the end of the log. A hit
+ * logged as just its frame gets the page the misses and swap-ins before it
+ * put there.
+ */
+static int read_event(FILE* fp, FrameMap* frames, struct event* e) {
+    uint32_t w;
+
+    if (fread(&w, sizeof(w), 1, fp) != 1) {
+        return 0;
+    }
+    if (w < EV_TAG) {
+        if (w >= frames->size || frames->pages[w] == 0) {
+            fprintf(stderr, "Error: hit on frame %u before any page went "
+                    "into it\n", w);
+            exit(1);
+        }
+        e->type = EV_HIT;
+        e->frame = w;
+        e->page = frames->pages[w] - 1;
+        return 1;
+    }
+
+    e->type = w - EV_TAG;
+    e->frame = read_word(fp);
+    e->page = read_word(fp);
+    e->page |= (uint64_t) read_word(fp) << 32;
+    if (e->type >= EV_TYPES) {
+        fprintf(stderr, "Error: unknown event type %u\n", e->type);
+        exit(1);
+    }
+    if (e->frame != EV_NO_FRAME &&
+        (e->type == EV_MISS || e->type == EV_SWAP_IN || e->type == EV_HIT)) {
+        frame_bind(frames, e->frame, e->page);
+    }
+    return 1;
+}
+
+/* Summarizes an event log written by sim -E: how many events of each kind
+ * there were, how far apart (in distinct pages) references to the same
+ * page are, and how long pages had gone unused, and had been resident,
+ * when they were evicted.
+ */
+int main(int argc, char* argv[]) {
+    struct evlog_header header;
+    struct event e;
+    unsigned long counts[EV_TYPES] = {0};
+    unsigned long reuse[BUCKETS] = {0};
+    unsigned long idle[BUCKETS] = {0};
+    unsigned long residency[BUCKETS] = {0};
+    unsigned long unreferenced = 0;
+    unsigned long time = 0;     // Index of the reference being logged
+    PageTable pages = {NULL, 0, 0};
+    FrameMap frames = {NULL, 0};
+    unsigned long d, max, n;
+
+    if (argc != 2) {
+        fprintf(stderr, "USAGE: evsum eventlog\n");
+        exit(1);
+    }
+    FILE* fp = fopen(argv[1], "r");
+    if (fp == NULL) {
+        perror("Error opening event log");
+        exit(1);
+    }
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        memcmp(header.magic, EVLOG_MAGIC, EVLOG_MAGIC_LEN) != 0) {
+        fprintf(stderr, "Error: %s is not an event log\n", argv[1]);
+        exit(1);
+    }
+    if (header.version != EVLOG_VERSION ||
+        header.word_size != sizeof(uint32_t)) {
+        fprintf(stderr, "Error: %s is version %u with %u byte words, "
+                "expected version %u with %u\n", argv[1], header.version,
+                header.word_size, EVLOG_VERSION,
+                (unsigned) sizeof(uint32_t));
+        exit(1);
+    }
+    // A sampled log stands for n times its pages and references
+    n = header.sample;
+
+    // Reuse distance is LRU stack distance less one
+    struct mrc* stack = mrc_create(MRC_LRU, 0);
+
+    while (read_event(fp, &frames, &e)) {
+        counts[e.type]++;
+
+        PageInfo* p = page_info(&pages, e.page);
+        switch (e.type) {
+            case EV_MISS:
+                p->faulted = time;
+                p->has_faulted = 1;
+                // Fall through
+            case EV_HIT:
+                mrc_ref(stack, e.page);
+                p->last_ref = time;
+                p->referenced = 1;
+                time++;     // The last event of this reference
+                break;
+            case EV_EVICT_CLEAN:
+            case EV_EVICT_DIRTY:
+                if (!p->referenced) {
+                    unreferenced += n;
+                } else {
+                    idle[bucket((time - p->last_ref) * n)] += n;
+                }
+                if (p->has_faulted) {
+                    residency[bucket((time - p->faulted) * n)] += n;
+                }
+                p->referenced = 0;
+                p->has_faulted = 0;
+                break;
+        }
+    }
+    fclose(fp);
+
+    max = mrc_max_distance(stack);
+    for (d = 1; d <= max; d++) {
+        reuse[bucket((d - 1) * n)] += mrc_distance_count(stack, d) * n;
+    }
+
+    if (n > 1) {
+        printf("Sampled 1 in %lu pages; figures are scaled up to estimate "
+               "the whole run\n\n", n);
+    }
+    for (d = 0; d < EV_TYPES; d++) {
+        printf("%-12s %lu\n", event_names[d], counts[d] * n);
+    }
+    printf("Pages: %lu\n\n", (unsigned long) pages.count * n);
+    printf("First references: %lu\n", mrc_cold_count(stack) * n);
+    print_hist("Reuse distance (distinct pages referenced in between)", reuse);
+    printf("\nEvicted before being referenced: %lu\n", unreferenced);
+    print_hist("Eviction age (references since the page was last used)", idle);
+    print_hist("\nResidency at eviction (references since it was faulted in)",
+               residency);
+
+    mrc_destroy(stack);
+    free(pages.slots);
+    free(frames.pages);
+    return 0;
+}
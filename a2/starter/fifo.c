@@ -3,24 +3,22 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <stdlib.h>
+#include "sim.h"
 #include "pagetable.h"
 
 
-extern int memsize;
-
 extern int debug;
 
-extern struct frame *coremap;
-
 
 //region Circular Queue Implementation
 
-// Queue of NON-NEGATIVE integers
+// Queue of NON-NEGATIVE integers less than size, each queued at most once
 typedef struct {
     int size;
     int front; // Index of the front of the queue
     int back; // Index of the front of the queue
     int* contents; // Array of NON-NEGATIVE integers (-1 implies emptiness)
+    char* queued; // queued[value] = 1 iff value is in the queue
 } Queue;
 static int EMPTY_QUEUE_SLOT = -1;
 
@@ -41,6 +39,7 @@ Queue* makeQueue(int size){
     ret->front = 0;
     ret->back = 0;
     ret->contents = initContents(size);
+    ret->queued = calloc(size, sizeof(char));
 
     return ret;
 }
@@ -49,6 +48,7 @@ Queue* makeQueue(int size){
 void enqueue(Queue* q, int value){
     // Set the value at the back of the queue
     q->contents[q->back] = value;
+    q->queued[value] = 1;
 
     // Move the back rightwards, but make sure to loop around
     q->back = (q->back + 1) % (q->size);
@@ -63,31 +63,25 @@ int dequeue(Queue* q){
     // Only move the front if it's non-empty
     if (ret != EMPTY_QUEUE_SLOT){
         q->contents[q->front] = EMPTY_QUEUE_SLOT; // Remove the old front value
+        q->queued[ret] = 0;
         q->front = (q->front + 1) % (q->size); // Move front towards back
     }
 
     return ret;
 }
 
-// Return whether value is in q
+// Return whether value is in q, in O(1) rather than scanning contents
 int contains(Queue* q, int value){
-    int i;
-    // Loop from front (leftmost), to back (rightmost)
-    for (i = 0; i < q->size; i++){
-        if (q->contents[i] == value){
-            return 1;
-        }
-    }
-    return 0;
+    return q->queued[value];
 }
 
 //endregion
 
-// Circular queue of page numbers
-Queue* queue;
+// Each instance's s->alg_data is its circular queue of frame numbers
 
+int fifo_evict(struct sim *s) {
+    Queue* queue = s->alg_data;
 
-int fifo_evict() {
     // Dequeue a frame number (should be the oldest in the queue)
 	return dequeue(queue);
 }
@@ -96,10 +90,13 @@ int fifo_evict() {
  * needed by the fifo algorithm.
  * Input: The page table entry for the page that is being accessed.
  */
-void fifo_ref(pgtbl_entry_t *p) {
-    int base_frame_number = p->frame >> PAGE_SHIFT;
+void fifo_ref(struct sim *s, pgtbl_entry_t *p) {
+    Queue* queue = s->alg_data;
+    int base_frame_number = pte_frame(p);
 
-    // Enqueue base_frame_number if it's new
+    // Enqueue base_frame_number if it's new. A frame leaves the queue only
+    // when it is evicted, so this is true exactly on the first reference
+    // after the frame is allocated, and hits cost one lookup.
     if (!contains(queue, base_frame_number)){
         enqueue(queue, base_frame_number);
     }
@@ -108,7 +105,7 @@ void fifo_ref(pgtbl_entry_t *p) {
 /* Initialize any data structures needed for this 
  * replacement algorithm 
  */
-void fifo_init() {
+void fifo_init(struct sim *s) {
     // Initialize circular queue
-    queue = makeQueue(memsize);
+    s->alg_data = makeQueue(s->memsize);
 }
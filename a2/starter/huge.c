@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "sim.h"
+#include "huge.h"
+#include "tlb.h"
+
+//region DESCRIPTION OF HUGE PAGE IMPLEMENTATION
+
+/*
+ * Each huge frame is HUGE_PAGES simulated base pages of memory, so a
+ * reference into a huge page returns the same kind of pointer a base page
+ * would. Huge frames are found by the directory entry mapping their region
+ * (which is unique even when processes use the same addresses) through a
+ * small hash table, with linear probing and backward shift deletion.
+ *
+ * Promotion copies the region's resident base pages into the huge frame,
+ * reads the ones on swap back in and initializes the rest like fresh
+ * pages. The base frames themselves are left to the replacement algorithm:
+ * nothing references them while the region is huge, so they age out and
+ * are evicted like any cold page. The region's page table is kept.
+ *
+ * Demotion clears PDE_HUGE and the region's touch count, so it has to be
+ * touched all over again to be promoted again. Evicting a huge page is
+ * counted as clean or dirty like a base eviction. A dirty huge page hands
+ * the pages it touched back to the page table: resident ones are copied
+ * into their base frame and marked dirty, the others are written to swap.
+ * */
+
+//endregion
+
+typedef struct {
+    pgdir_entry_t* pmd;     // Directory entry mapping this frame
+    addr_t region;          // vaddr >> HUGE_SHIFT of the mapped region
+    unsigned long stamp;    // Last use, to evict the least recently used
+    char dirty;
+    unsigned touched;       // Number of bits set in touched_map
+    uint64_t touched_map[HUGE_PAGES / 64];
+} HugeFrame;
+
+struct huge {
+    unsigned nframes;
+    unsigned nused;
+    unsigned threshold;
+    HugeFrame* frames;
+    char* mem;              // HUGE_PAGES * SIMPAGESIZE bytes per frame
+    int* table;             // Frame index by pmd, or -1
+    unsigned table_size;    // Always a power of two
+    unsigned long clock;
+
+    unsigned long fault_count;
+    unsigned long evict_clean_count;
+    unsigned long evict_dirty_count;
+    unsigned long swapin_count; // Base pages read from swap on promotion
+    unsigned long untouched;    // Over huge pages already evicted
+};
+
+struct huge* huge_create(unsigned nframes, unsigned threshold) {
+    struct huge* h = calloc(1, sizeof(struct huge));
+    unsigned i;
+
+    h->nframes = nframes;
+    h->threshold = threshold;
+    h->frames = calloc(nframes, sizeof(HugeFrame));
+    h->mem = malloc((size_t) nframes * HUGE_PAGES * SIMPAGESIZE);
+    for (h->table_size = 1; h->table_size < 2 * nframes; h->table_size *= 2);
+    h->table = malloc(h->table_size * sizeof(int));
+    for (i = 0; i < h->table_size; i++) {
+        h->table[i] = -1;
+    }
+    return h;
+}
+
+void huge_destroy(struct huge* h) {
+    free(h->table);
+    free(h->mem);
+    free(h->frames);
+    free(h);
+}
+
+unsigned huge_threshold(struct huge* h) {
+    return h->threshold;
+}
+
+//region REGION TABLE
+
+static unsigned table_home(struct huge* h, pgdir_entry_t* pmd) {
+    return (unsigned) (((uintptr_t) pmd >> 3) * 0x9E3779B97F4A7C15UL >> 32) &
+           (h->table_size - 1);
+}
+
+// Slot holding pmd's frame, or the empty slot where it would go
+static unsigned table_find(struct huge* h, pgdir_entry_t* pmd) {
+    unsigned i = table_home(h, pmd);
+    while (h->table[i] != -1 && h->frames[h->table[i]].pmd != pmd) {
+        i = (i + 1) & (h->table_size - 1);
+    }
+    return i;
+}
+
+static void table_remove(struct huge* h, pgdir_entry_t* pmd) {
+    unsigned mask = h->table_size - 1;
+    unsigned hole = table_find(h, pmd);
+    unsigned i;
+
+    assert(h->table[hole] != -1);
+    h->table[hole] = -1;
+
+    // Move later entries of the probe run back into the hole, unless their
+    // home lies cyclically after the hole
+    for (i = (hole + 1) & mask; h->table[i] != -1; i = (i + 1) & mask) {
+        unsigned home = table_home(h, h->frames[h->table[i]].pmd);
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            h->table[hole] = h->table[i];
+            h->table[i] = -1;
+            hole = i;
+        }
+    }
+}
+
+//endregion
+
+// Copies the pages a dirty huge frame touched back to the region's pages
+static void huge_writeback(struct sim* s, int frame) {
+    HugeFrame* f = &s->huge->frames[frame];
+    pgtbl_entry_t* pgtbl = (pgtbl_entry_t*) (f->pmd->pde & PAGE_MASK);
+    unsigned i;
+
+    for (i = 0; i < HUGE_PAGES; i++) {
+        char* mem_ptr = &s->huge->mem[((size_t) frame * HUGE_PAGES + i) * SIMPAGESIZE];
+
+        if (!(f->touched_map[i / 64] & ((uint64_t) 1 << (i % 64)))) {
+            continue;
+        }
+        if (pte_test(&pgtbl[i], PG_VALID)) {
+            memcpy(&s->physmem[pte_frame(&pgtbl[i]) * SIMPAGESIZE], mem_ptr,
+                   SIMPAGESIZE);
+            pte_set(&pgtbl[i], PG_DIRTY);
+        } else {
+            pte_set_swap_off(&pgtbl[i],
+                             swap_write(s, mem_ptr, pte_swap_off(&pgtbl[i])));
+            pte_set(&pgtbl[i], PG_ONSWAP);
+        }
+    }
+}
+
+// Demotes the least recently used huge page and returns its frame
+static int huge_evict(struct sim* s) {
+    struct huge* h = s->huge;
+    int victim = 0;
+    unsigned i;
+
+    for (i = 1; i < h->nframes; i++) {
+        if (h->frames[i].stamp < h->frames[victim].stamp) {
+            victim = i;
+        }
+    }
+
+    HugeFrame* f = &h->frames[victim];
+    if (f->dirty) {
+        huge_writeback(s, victim);
+        h->evict_dirty_count++;
+    } else {
+        h->evict_clean_count++;
+    }
+    h->untouched += HUGE_PAGES - f->touched;
+    f->pmd->pde &= PAGE_MASK | PG_VALID; // Clears PDE_HUGE and the touches
+    table_remove(h, f->pmd);
+    return victim;
+}
+
+char* huge_fault(struct sim* s, pgdir_entry_t* pmd, addr_t vaddr, char type) {
+    struct huge* h = s->huge;
+    pgtbl_entry_t* pgtbl = (pgtbl_entry_t*) (pmd->pde & PAGE_MASK);
+    int frame;
+    unsigned i;
+
+    if (h->nused < h->nframes) {
+        frame = h->nused++;
+    } else {
+        frame = huge_evict(s);
+        cost_evict(&s->cost, h->frames[frame].dirty);
+        // Only the current process' translations are cached, and pmd tells
+        // its region from another process' at the same address
+        if (s->tlb != NULL) {
+            tlb_invalidate_huge(s->tlb, h->frames[frame].region << HUGE_SHIFT,
+                                h->frames[frame].pmd);
+        }
+    }
+
+    HugeFrame* f = &h->frames[frame];
+    memset(f, 0, sizeof(HugeFrame));
+    f->pmd = pmd;
+    f->region = vaddr >> HUGE_SHIFT;
+    h->table[table_find(h, pmd)] = frame;
+    pmd->pde |= PDE_HUGE;
+    h->fault_count++;
+
+    // Fill the huge page from the region's resident and swapped out pages,
+    // and zero the rest recording their vaddr like init_frame does
+    for (i = 0; i < HUGE_PAGES; i++) {
+        char* mem_ptr = &h->mem[((size_t) frame * HUGE_PAGES + i) * SIMPAGESIZE];
+        addr_t page_vaddr = (f->region << HUGE_SHIFT) | ((addr_t) i << PAGE_SHIFT);
+
+        if (pte_test(&pgtbl[i], PG_VALID)) {
+            memcpy(mem_ptr, &s->physmem[pte_frame(&pgtbl[i]) * SIMPAGESIZE],
+                   SIMPAGESIZE);
+        } else if (pte_test(&pgtbl[i], PG_ONSWAP)) {
+            swap_read(s, mem_ptr, pte_swap_off(&pgtbl[i]));
+            h->swapin_count++;
+        } else {
+            memset(mem_ptr, 0, SIMPAGESIZE);
+            *(addr_t*) (mem_ptr + sizeof(int)) = page_vaddr;
+        }
+
+        // Base translations cached for the region would bypass the huge page
+        if (s->tlb != NULL) {
+            tlb_invalidate(s->tlb, page_vaddr);
+        }
+    }
+
+    return huge_ref(h, pmd, vaddr, type);
+}
+
+char* huge_ref(struct huge* h, pgdir_entry_t* pmd, addr_t vaddr, char type) {
+    int frame = h->table[table_find(h, pmd)];
+    assert(frame != -1);
+
+    HugeFrame* f = &h->frames[frame];
+    unsigned page = (unsigned) (vaddr >> PAGE_SHIFT) & (HUGE_PAGES - 1);
+
+    f->stamp = ++h->clock;
+    if (type == 'M' || type == 'S') {
+        f->dirty = 1;
+    }
+    if (!(f->touched_map[page / 64] & ((uint64_t) 1 << (page % 64)))) {
+        f->touched_map[page / 64] |= (uint64_t) 1 << (page % 64);
+        f->touched++;
+    }
+    return &h->mem[((size_t) frame * HUGE_PAGES + page) * SIMPAGESIZE];
+}
+
+unsigned long huge_fault_count(struct huge* h) {
+    return h->fault_count;
+}
+
+unsigned long huge_evict_clean_count(struct huge* h) {
+    return h->evict_clean_count;
+}
+
+unsigned long huge_evict_dirty_count(struct huge* h) {
+    return h->evict_dirty_count;
+}
+
+unsigned long huge_swapin_count(struct huge* h) {
+    return h->swapin_count;
+}
+
+unsigned long huge_untouched(struct huge* h) {
+    unsigned long untouched = h->untouched;
+    unsigned i;
+
+    for (i = 0; i < h->nused; i++) {
+        untouched += HUGE_PAGES - h->frames[i].touched;
+    }
+    return untouched;
+}
@@ -0,0 +1,46 @@
+#ifndef __HUGE_H__
+#define __HUGE_H__
+
+#include "pagetable.h"
+
+/* 2MB huge pages (-H frames[:threshold]).
+ *
+ * Huge pages come from their own pool of frames, on top of the base frames
+ * given with -m. A region is promoted when the number of its 4KB pages that
+ * have been touched reaches the threshold: the fault that gets there is
+ * served by a huge page, and its last-level directory entry is marked
+ * PDE_HUGE so later references bypass the region's page table. When the
+ * pool is full, the least recently used huge page is evicted and its
+ * region goes back to base pages.
+ */
+struct huge;
+struct sim;
+
+extern struct huge* huge_create(unsigned nframes, unsigned threshold);
+
+extern void huge_destroy(struct huge* h);
+
+extern unsigned huge_threshold(struct huge* h);
+
+// Promotes pmd's region and returns the simulated memory for vaddr
+extern char* huge_fault(struct sim* s, pgdir_entry_t* pmd, addr_t vaddr,
+                        char type);
+
+// Returns the simulated memory for vaddr in pmd's huge page
+extern char* huge_ref(struct huge* h, pgdir_entry_t* pmd, addr_t vaddr,
+                      char type);
+
+extern unsigned long huge_fault_count(struct huge* h);
+
+extern unsigned long huge_evict_clean_count(struct huge* h);
+
+extern unsigned long huge_evict_dirty_count(struct huge* h);
+
+// Base pages read back from swap when their region was promoted
+extern unsigned long huge_swapin_count(struct huge* h);
+
+// Internal fragmentation: 4KB pages of every huge page mapped so far that
+// were never referenced while it was mapped, out of HUGE_PAGES per page
+extern unsigned long huge_untouched(struct huge* h);
+
+#endif // __HUGE_H__
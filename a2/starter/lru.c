@@ -3,67 +3,73 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <stdlib.h>
+#include "sim.h"
 #include "pagetable.h"
 
-extern int memsize;
-
 extern int debug;
 
-extern struct frame* coremap;
-
-unsigned* timestamp_list;
-unsigned timestamp;
-
 //region DESCRIPTION OF LRU IMPLEMENTATION
 
 /*
- * We are going to be implementing exact LRU with timestamps
- * Thus each PTE needs a timestamp, so we will maintain an array of unsigned timestamps.
- * The indices of this array will be frame numbers.
- * Unsigned int timestamps should be accurate within 2^32 - 1 references, which is very large.
+ * We implement exact LRU with a recency list threaded through the frames.
+ * next[] and prev[] are indexed by frame number and link the frames
+ * from most recently used (head) to least recently used (tail). Slot
+ * memsize is a sentinel, so the list is circular and never empty:
+ *      next[SENTINEL] is the most recently used frame
+ *      prev[SENTINEL] is the least recently used frame
  *
- * We are using the timestamp implementation because
- *      eviction is much less frequent than referencing (when memory is sufficiently large)
- * Timestamp gives us O(n) eviction and O(1) referencing
- * Stack implementation would give O(1) eviction but O(n) referencing
+ * A reference unlinks the frame and relinks it at the head, and eviction
+ * takes the tail, so both lru_ref() and lru_evict() are O(1).
+ * Frames that are not on the list have next[frame] == NOT_LINKED.
+ *
+ * The older timestamp implementation (O(1) referencing, O(memsize)
+ * eviction) lives on in bench_policy.c as lru-ts, for benchmarking against.
  * */
 
 //endregion
 
-unsigned get_timestamp(pgtbl_entry_t* p){
-    int frame_number = p->frame >> PAGE_SHIFT;
-    return timestamp_list[frame_number];
+//region RECENCY LIST IMPLEMENTATION
+
+#define NOT_LINKED (-1)
+#define SENTINEL(s) ((int) (s)->memsize)
+
+// Each instance's s->alg_data
+typedef struct {
+    int* next;
+    int* prev;
+} RecencyList;
+
+static void unlink_frame(RecencyList* l, int frame_number) {
+    l->next[l->prev[frame_number]] = l->next[frame_number];
+    l->prev[l->next[frame_number]] = l->prev[frame_number];
+    l->next[frame_number] = l->prev[frame_number] = NOT_LINKED;
 }
 
-void set_timestamp(pgtbl_entry_t* p) {
-    int frame_number = p->frame >> PAGE_SHIFT;
-    timestamp_list[frame_number] = timestamp;
-    timestamp++;
+// Links frame_number in as the most recently used frame
+static void push_front(RecencyList* l, int sentinel, int frame_number) {
+    int old_head = l->next[sentinel];
+    l->next[frame_number] = old_head;
+    l->prev[frame_number] = sentinel;
+    l->prev[old_head] = frame_number;
+    l->next[sentinel] = frame_number;
 }
 
+//endregion
+
 /* Page to evict is chosen using the accurate LRU algorithm.
  * Returns the page frame number (which is also the index in the coremap)
  * for the page that is to be evicted.
  */
-int lru_evict() {
+int lru_evict(struct sim* s) {
+    RecencyList* l = s->alg_data;
 
-    int i;
-    int oldest_ind = 0; // Index of oldest frame
-
-    // Loop through all page tables
-    for (i = 0; i < memsize; i++){
-        struct frame cur_frame = coremap[i];
-        struct frame oldest_frame = coremap[oldest_ind];
-        if (get_timestamp(cur_frame.pte) < get_timestamp(oldest_frame.pte)){
-            oldest_ind = i;
-        }
-    }
-
-    // Frame bits of the oldest frame
-    unsigned frame = coremap[oldest_ind].pte->frame;
+    // The tail of the list is the least recently used frame
+    int oldest = l->prev[SENTINEL(s)];
+    assert(oldest != SENTINEL(s));
 
-    // Return the frame number of the oldest frame
-    return frame >> PAGE_SHIFT;
+    // The frame will be relinked when its new page is referenced
+    unlink_frame(l, oldest);
+    return oldest;
 }
 
 /* This function is called on each access to a page to update any information
@@ -71,15 +77,32 @@ int lru_evict() {
  * Input: The page table entry for the page that is being accessed.
  */
 
-void lru_ref(pgtbl_entry_t* p) {
-    set_timestamp(p);
-    return;
+void lru_ref(struct sim* s, pgtbl_entry_t* p) {
+    RecencyList* l = s->alg_data;
+    int frame_number = pte_frame(p);
+
+    // Already at the head, nothing to move
+    if (l->next[SENTINEL(s)] == frame_number) {
+        return;
+    }
+
+    if (l->next[frame_number] != NOT_LINKED) {
+        unlink_frame(l, frame_number);
+    }
+    push_front(l, SENTINEL(s), frame_number);
 }
 
 /* Initialize any data structures needed for this 
  * replacement algorithm 
  */
-void lru_init() {
-    timestamp = 0;
-    timestamp_list = calloc((size_t) memsize, sizeof(unsigned));
+void lru_init(struct sim* s) {
+    int i;
+    RecencyList* l = malloc(sizeof(RecencyList));
+    l->next = malloc(sizeof(int) * (s->memsize + 1));
+    l->prev = malloc(sizeof(int) * (s->memsize + 1));
+    for (i = 0; i < s->memsize; i++) {
+        l->next[i] = l->prev[i] = NOT_LINKED;
+    }
+    l->next[SENTINEL(s)] = l->prev[SENTINEL(s)] = SENTINEL(s);
+    s->alg_data = l;
 }
@@ -0,0 +1,348 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "sim.h"
+#include "mrc.h"
+
+// Shared with opt.c, which builds them from tracefile
+extern unsigned* next_use;
+extern unsigned num_refs;
+
+extern void buildNextUse(char* trace_path);
+
+#define NEVER ((unsigned) -1)
+#define NO_PAGE ((addr_t) -1)
+
+//region DESCRIPTION OF MRC IMPLEMENTATION
+
+/*
+ * LRU: the stack distance of a reference is one more than the number of
+ * distinct pages referenced since the previous reference to the same page.
+ * Every page marks the time of its latest reference in a Fenwick tree over
+ * time, so that count is a prefix sum: O(log N) per reference. When the
+ * time axis fills up, the live marks (one per distinct page) are packed to
+ * the front, so memory stays proportional to the number of distinct pages.
+ *
+ * OPT: Mattson's priority stack, where a page's priority is its next use
+ * (from the next_use array built for sim -a opt). The referenced page moves
+ * to the top and displaced pages bubble down, keeping the sooner-used page
+ * at each level. That is O(depth) per reference, so the stack is cut off at
+ * maxframes when a bound is given.
+ * */
+
+//endregion
+
+typedef struct {
+    addr_t page;
+    unsigned next;   // Next use of page (OPT priority; smaller is higher)
+} StackEntry;
+
+struct mrc {
+    int kind;
+    unsigned maxframes;
+
+    unsigned long* hist;   // hist[d]: references with stack distance d
+    size_t hist_len;
+    unsigned long refs;
+    unsigned long cold;    // First references: miss at every size
+
+    // LRU: page -> time of latest reference, open addressing on page + 1
+    addr_t* keys;
+    unsigned long* last;
+    size_t capacity;
+    size_t count;
+    unsigned* tree;        // Fenwick tree over time, 1-based
+    addr_t* owner;         // Page whose latest reference is at each time
+    unsigned long tree_len;
+    unsigned long now;     // Time of the latest reference
+
+    // OPT
+    StackEntry* stack;
+    size_t depth;
+    size_t stack_cap;
+};
+
+int mrc_kind(const char* name) {
+    if (strcmp(name, "lru-mrc") == 0) {
+        return MRC_LRU;
+    }
+    if (strcmp(name, "opt-mrc") == 0) {
+        return MRC_OPT;
+    }
+    return -1;
+}
+
+void record_distance(struct mrc* m, size_t d) {
+    if (d >= m->hist_len) {
+        size_t old = m->hist_len;
+        while (d >= m->hist_len) {
+            m->hist_len *= 2;
+        }
+        m->hist = realloc(m->hist, m->hist_len * sizeof(unsigned long));
+        memset(m->hist + old, 0, (m->hist_len - old) * sizeof(unsigned long));
+    }
+    m->hist[d]++;
+}
+
+//region LRU STACK DISTANCE
+
+size_t page_slot(struct mrc* m, addr_t page) {
+    size_t mask = m->capacity - 1;
+    size_t slot = (size_t) (page * 0x9E3779B97F4A7C15ull >> 20) & mask;
+    while (m->keys[slot] != 0 && m->keys[slot] != page + 1) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+void grow_pages(struct mrc* m) {
+    addr_t* old_keys = m->keys;
+    unsigned long* old_last = m->last;
+    size_t old_capacity = m->capacity;
+    size_t i;
+
+    m->capacity *= 2;
+    m->keys = calloc(m->capacity, sizeof(addr_t));
+    m->last = malloc(m->capacity * sizeof(unsigned long));
+    for (i = 0; i < old_capacity; i++) {
+        if (old_keys[i] != 0) {
+            size_t slot = page_slot(m, old_keys[i] - 1);
+            m->keys[slot] = old_keys[i];
+            m->last[slot] = old_last[i];
+        }
+    }
+    free(old_keys);
+    free(old_last);
+}
+
+void tree_add(struct mrc* m, unsigned long t, int delta) {
+    for (; t <= m->tree_len; t += t & -t) {
+        m->tree[t] += delta;
+    }
+}
+
+unsigned long tree_prefix(struct mrc* m, unsigned long t) {
+    unsigned long sum = 0;
+    for (; t > 0; t -= t & -t) {
+        sum += m->tree[t];
+    }
+    return sum;
+}
+
+/* Packs the live marks (one per distinct page) into times 1..count, in order,
+ * and resizes the time axis to leave at least as much room again.
+ */
+void compact_times(struct mrc* m) {
+    unsigned long old_len = m->tree_len;
+    addr_t* old_owner = m->owner;
+    unsigned long t, packed = 0;
+
+    m->tree_len = 2 * m->count + 1024;
+    m->owner = malloc((m->tree_len + 1) * sizeof(addr_t));
+    free(m->tree);
+    m->tree = calloc(m->tree_len + 1, sizeof(unsigned));
+
+    for (t = 1; t <= old_len; t++) {
+        if (old_owner[t] != NO_PAGE) {
+            packed++;
+            m->owner[packed] = old_owner[t];
+            m->last[page_slot(m, old_owner[t])] = packed;
+            m->tree[packed] = 1;
+        }
+    }
+    for (t = packed + 1; t <= m->tree_len; t++) {
+        m->owner[t] = NO_PAGE;
+    }
+
+    // Turn the 0/1 array into a Fenwick tree in place
+    for (t = 1; t <= m->tree_len; t++) {
+        unsigned long parent = t + (t & -t);
+        if (parent <= m->tree_len) {
+            m->tree[parent] += m->tree[t];
+        }
+    }
+    m->now = packed;
+    free(old_owner);
+}
+
+void lru_mrc_ref(struct mrc* m, addr_t page) {
+    if (m->now == m->tree_len) {
+        compact_times(m);
+    }
+    unsigned long t = ++m->now;
+    size_t slot = page_slot(m, page);
+
+    if (m->keys[slot] == 0) {
+        m->cold++;
+        if ((m->count + 1) * 2 > m->capacity) {
+            grow_pages(m);
+            slot = page_slot(m, page);
+        }
+        m->keys[slot] = page + 1;
+        m->count++;
+    } else {
+        // Distinct pages referenced since, plus this one
+        unsigned long prev = m->last[slot];
+        record_distance(m, m->count - tree_prefix(m, prev) + 1);
+        tree_add(m, prev, -1);
+        m->owner[prev] = NO_PAGE;
+    }
+
+    tree_add(m, t, 1);
+    m->owner[t] = page;
+    m->last[slot] = t;
+}
+
+//endregion
+
+//region OPT STACK DISTANCE
+
+void opt_mrc_ref(struct mrc* m, addr_t page) {
+    unsigned long t = m->refs;
+    size_t i, pos;
+    int drop = 0;   // pos holds a real page, so one of two must fall off
+
+    assert(t < num_refs);
+    for (pos = 0; pos < m->depth; pos++) {
+        if (m->stack[pos].page == page) {
+            break;
+        }
+    }
+    if (pos < m->depth) {
+        record_distance(m, pos + 1);
+    } else {
+        // Never seen, or pushed out of the bounded stack: a miss at every size
+        m->cold++;
+        if (m->depth < m->stack_cap) {
+            m->depth++;
+        } else {
+            drop = 1;
+        }
+        pos = m->depth - 1;
+    }
+
+    // Move page to the top and bubble the displaced pages down to pos,
+    // keeping the one that is needed sooner at each level
+    StackEntry carried = m->stack[0];
+    m->stack[0].page = page;
+    m->stack[0].next = next_use[t];
+    for (i = 1; i <= pos; i++) {
+        if ((i == pos && !drop) || carried.next < m->stack[i].next) {
+            StackEntry tmp = m->stack[i];
+            m->stack[i] = carried;
+            carried = tmp;
+        }
+    }
+}
+
+//endregion
+
+struct mrc* mrc_create(int kind, unsigned maxframes) {
+    struct mrc* m = calloc(1, sizeof(struct mrc));
+
+    m->kind = kind;
+    m->maxframes = maxframes;
+    m->hist_len = 1024;
+    m->hist = calloc(m->hist_len, sizeof(unsigned long));
+
+    if (kind == MRC_LRU) {
+        m->capacity = 1024;
+        m->keys = calloc(m->capacity, sizeof(addr_t));
+        m->last = malloc(m->capacity * sizeof(unsigned long));
+        m->tree_len = 0;
+        m->owner = malloc(sizeof(addr_t));
+    } else {
+        // Priorities come from the whole trace, read ahead of the replay
+        if (tracefile == NULL) {
+            fprintf(stderr, "Error: opt-mrc requires a tracefile (-f)\n");
+            exit(1);
+        }
+        if (next_use == NULL) {
+            buildNextUse(tracefile);
+        }
+        m->stack_cap = maxframes != 0 ? maxframes : 1024;
+        m->stack = malloc(m->stack_cap * sizeof(StackEntry));
+    }
+    return m;
+}
+
+void mrc_ref(struct mrc* m, addr_t page) {
+    if (m->kind == MRC_LRU) {
+        lru_mrc_ref(m, page);
+    } else {
+        // An unbounded stack grows as needed
+        if (m->maxframes == 0 && m->depth == m->stack_cap) {
+            m->stack_cap *= 2;
+            m->stack = realloc(m->stack, m->stack_cap * sizeof(StackEntry));
+        }
+        opt_mrc_ref(m, page);
+    }
+    m->refs++;
+}
+
+void mrc_destroy(struct mrc* m) {
+    free(m->hist);
+    free(m->keys);
+    free(m->last);
+    free(m->tree);
+    free(m->owner);
+    free(m->stack);
+    free(m);
+}
+
+// Largest memory size worth reporting: the bound, or the deepest distance seen
+unsigned long curve_len(struct mrc* m) {
+    if (m->maxframes != 0) {
+        return m->maxframes;
+    }
+    return mrc_max_distance(m);
+}
+
+unsigned long mrc_max_distance(struct mrc* m) {
+    unsigned long d;
+    for (d = m->hist_len - 1; d > 0 && m->hist[d] == 0; d--);
+    return d;
+}
+
+unsigned long mrc_distance_count(struct mrc* m, unsigned long d) {
+    return d < m->hist_len ? m->hist[d] : 0;
+}
+
+unsigned long mrc_cold_count(struct mrc* m) {
+    return m->cold;
+}
+
+void mrc_print_csv(FILE* out, struct mrc** curves, int ncurves) {
+    char* names[] = {"lru", "opt"};
+    unsigned long frames, len = 0;
+    unsigned long* misses = calloc(ncurves, sizeof(unsigned long));
+    int i;
+
+    fprintf(out, "frames");
+    for (i = 0; i < ncurves; i++) {
+        fprintf(out, ",%s_misses,%s_miss_rate", names[curves[i]->kind],
+                names[curves[i]->kind]);
+        if (curve_len(curves[i]) > len) {
+            len = curve_len(curves[i]);
+        }
+        // With no frames every reference misses
+        misses[i] = curves[i]->refs;
+    }
+    fprintf(out, "\n");
+
+    // Misses at M frames: every reference with stack distance above M
+    for (frames = 1; frames <= len; frames++) {
+        fprintf(out, "%lu", frames);
+        for (i = 0; i < ncurves; i++) {
+            struct mrc* m = curves[i];
+            if (frames < m->hist_len) {
+                misses[i] -= m->hist[frames];
+            }
+            fprintf(out, ",%lu,%.4f", misses[i],
+                    m->refs ? (double) misses[i] / m->refs * 100 : 0.0);
+        }
+        fprintf(out, "\n");
+    }
+    free(misses);
+}
@@ -0,0 +1,43 @@
+#ifndef __MRC_H__
+#define __MRC_H__
+
+#include <stdio.h>
+#include "pagetable.h"
+#include "trace.h"
+
+/* Miss-ratio curves from stack distances (Mattson et al.).
+ *
+ * LRU and OPT are stack algorithms: a reference hits in a memory of M
+ * frames exactly when its stack distance is at most M. Replaying the trace
+ * once and recording a histogram of stack distances therefore gives the
+ * number of misses for every memory size at once.
+ */
+#define MRC_LRU 0
+#define MRC_OPT 1
+
+struct mrc;
+
+// Returns MRC_LRU/MRC_OPT for "lru-mrc"/"opt-mrc", or -1
+extern int mrc_kind(const char* name);
+
+// maxframes bounds the curve (and OPT's stack); 0 means unbounded
+extern struct mrc* mrc_create(int kind, unsigned maxframes);
+
+// page names the page referenced, as given by trace_page()
+extern void mrc_ref(struct mrc* m, addr_t page);
+
+extern void mrc_destroy(struct mrc* m);
+
+// The stack distance histogram itself: references that found their page
+// at depth d (1 being the page referenced last), up to the deepest one
+// seen, and first references to a page
+extern unsigned long mrc_max_distance(struct mrc* m);
+
+extern unsigned long mrc_distance_count(struct mrc* m, unsigned long d);
+
+extern unsigned long mrc_cold_count(struct mrc* m);
+
+// Writes "frames,<alg>_misses,<alg>_miss_rate,..." for 1..maxframes frames
+extern void mrc_print_csv(FILE* out, struct mrc** curves, int ncurves);
+
+#endif // __MRC_H__
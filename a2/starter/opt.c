@@ -3,459 +3,375 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <stdlib.h>
+#include <limits.h>
+#include "sim.h"
 #include "pagetable.h"
 
-extern int memsize;
+//region DESCRIPTION OF OPT IMPLEMENTATION
+
+/*
+ * Belady's algorithm needs, for every frame, the time its page will next be
+ * referenced. We precompute that in opt_init() with a single backward pass
+ * over the trace: next_use[t] is the index of the next reference to the page
+ * referenced at time t, or NEVER. Only next_use is kept for the replay
+ * (4 bytes per reference); the page numbers are dropped once it is built.
+ * The array is read-only during replay, so every OPT instance shares it.
+ *
+ * During replay each frame's key is the next use of the page it holds, and
+ * the frames are kept in an indexed max-heap on that key. opt_evict() is the
+ * top of the heap and opt_ref() re-keys one frame, so both are O(log memsize).
+ *
+ * With a window (-w, or always when the trace comes from stdin) nothing is
+ * read in advance. The trace's lookahead hands us each reference as it is
+ * read, up to opt_window references before it is replayed, and we link it to
+ * the previous occurrence of its page still in the window. Pages with no use
+ * inside the window are ordered least recently used first. Memory is bounded
+ * by the window plus memsize, and the result is exact OPT whenever the
+ * window covers the rest of the trace.
+ * */
 
-extern int debug;
+//endregion
 
-extern struct frame* coremap;
+#define NEVER ((unsigned) -1)
 
-extern char* tracefile;
+// Frames whose page has no known next use are keyed FAR_KEY - last use
+#define FAR_KEY ULONG_MAX
 
-extern pgdir_entry_t pgdir[PTRS_PER_PGDIR];
+// Window used when the trace can only be read once (stdin)
+#define OPT_DEFAULT_WINDOW (1 << 20)
 
-//region DYNAMIC ARRAY IMPLEMENTATION
+//region PAGE -> LAST USE HASH TABLE
 
+/* Open addressing table used only while building next_use. Keys are page
+ * numbers + 1 so that 0 can mark an empty slot.
+ */
 typedef struct {
-    void** contents;
+    addr_t* keys;
+    unsigned* values;
+    size_t capacity; // Always a power of two
     size_t count;
-    size_t capacity;
-} List;
-
-void** initNullContents(size_t size) {
-    void** ret = malloc(sizeof(void*) * size);
-    int i;
-    for (i = 0; i < size; i++) {
-        ret[i] = NULL;
-    }
-    return ret;
-}
+} PageTable;
 
-List* makeList(size_t size) {
-    List* ret = malloc(sizeof(List));
-    ret->contents = initNullContents(size);
-    ret->count = 0;
-    ret->capacity = size;
-    return ret;
+void pageTableInit(PageTable* table, size_t capacity) {
+    table->capacity = capacity;
+    table->count = 0;
+    table->keys = calloc(capacity, sizeof(addr_t));
+    table->values = malloc(capacity * sizeof(unsigned));
 }
 
-void destroyList(List* list) {
-    free(list->contents);
-    list->contents = NULL;
-    list->count = list->capacity = 0;
-    free(list);
+void pageTableDestroy(PageTable* table) {
+    free(table->keys);
+    free(table->values);
 }
 
-// TODO SEE IF REALLOC WORKS
-void** transferContents(size_t oldSize, size_t newSize, void** oldContents) {
-
-    // Initialize new bin of contents
-    void** ret = initNullContents(newSize);
-
-    // Copy all content from the old contents over to the new one
-    int i;
-    for (i = 0; i < oldSize; i++) {
-        ret[i] = oldContents[i];
+// Returns the slot for page, which is empty if page is not in the table
+size_t pageTableSlot(PageTable* table, addr_t page) {
+    size_t mask = table->capacity - 1;
+    size_t slot = (size_t) (page * 0x9E3779B97F4A7C15ull >> 20) & mask;
+    while (table->keys[slot] != 0 && table->keys[slot] != page + 1) {
+        slot = (slot + 1) & mask;
     }
-
-    // Tear down the old content array
-    free(oldContents);
-
-    // Return the new content array
-    return ret;
+    return slot;
 }
 
-// Appends value to the end of list
-void listAppend(List* list, void* value) {
-
-    // How much to grow the array by
-    int GROWTH_RATE = 2;
-
-    // The array is now full, so expand it
-    if (list->count == list->capacity) {
-        size_t oldSize = list->capacity;
-        size_t newSize = oldSize * GROWTH_RATE;
-        void** newContents = transferContents(oldSize, newSize, list->contents);
-        list->contents = newContents;
-        list->capacity = newSize;
-    }
-
-    list->contents[list->count] = value;
-    list->count += 1;
-}
+void pageTableGrow(PageTable* table) {
+    PageTable bigger;
+    size_t i;
 
-// Finds the index that value occurs in list, or -1 if it does not
-int listFind(List* list, void* value) {
-    int i;
-    for (i = 0; i < list->count; i++) {
-        if (list->contents[i] == value) {
-            return i;
+    pageTableInit(&bigger, table->capacity * 2);
+    for (i = 0; i < table->capacity; i++) {
+        if (table->keys[i] != 0) {
+            size_t slot = pageTableSlot(&bigger, table->keys[i] - 1);
+            bigger.keys[slot] = table->keys[i];
+            bigger.values[slot] = table->values[i];
         }
     }
-    return -1;
+    bigger.count = table->count;
+    pageTableDestroy(table);
+    *table = bigger;
 }
 
-// Removes the value at index from the list and returns it
-void* listRemove(List* list, int index) {
+// Records that page is used at time, returning the previous time (or NEVER)
+unsigned pageTableSwap(PageTable* table, addr_t page, unsigned time) {
+    size_t slot = pageTableSlot(table, page);
+    unsigned old = NEVER;
 
-    // Index out of bounds
-    if (index < 0 || index > list->count - 1) {
-        return NULL;
+    if (table->keys[slot] != 0) {
+        old = table->values[slot];
+    } else {
+        table->keys[slot] = page + 1;
+        table->count++;
     }
+    table->values[slot] = time;
 
-    // Get what we're going to delete
-    void* deleted = list->contents[index];
-
-    // Shift everything over top of it from the right
-    int i;
-    for (i = index; i < list->count - 1; i++) {
-        list->contents[i] = list->contents[i + 1];
+    // Keep the load factor under 1/2
+    if (table->count * 2 > table->capacity) {
+        pageTableGrow(table);
     }
-    list->contents[list->count - 1] = NULL;
-
-    // Update list count to indicate that the list is now one shorter
-    list->count -= 1;
-
-    return deleted;
-}
-
-// Deletes a given value from the list
-void listDelete(List* list, void* value) {
-
-    // Find the index of the value
-    int ind = listFind(list, value);
-
-    // Abort if we could not find the value
-    if (ind == -1) {
-        return;
-    }
-
-    // Otherwise remove at the index
-    listRemove(list, ind);
-}
-
-// Removes the value from the end of the list and returns it
-void* listPop(List* list) {
-    int lastInd = (int) list->count - 1;
-    return listRemove(list, lastInd);
-}
-
-// Returns the last value in the list
-void* listPeek(List* list) {
-
-    // Abort, nothing is in the list
-    if (list->count == 0) {
-        return NULL;
-    }
-
-    size_t lastInd = list->count - 1;
-    return list->contents[lastInd];
+    return old;
 }
 
 //endregion
 
-//region HASH TABLE IMPLEMENTATION
+// Shared by every OPT instance replaying the (whole) trace
+unsigned* next_use;     // next_use[t]: time of the next reference after t
+unsigned num_refs;
 
-typedef struct {
-    unsigned key;
-    void* value;
-} KeyValuePair;
-
-KeyValuePair* makeKeyValuePair(unsigned key, void* value) {
-    KeyValuePair* ret = malloc(sizeof(KeyValuePair));
-    ret->key = key;
-    ret->value = value;
-    return ret;
-}
+//region LOOKAHEAD WINDOW ENTRIES
 
+/* Pages in the window or resident in a frame, keyed by page number + 1.
+ * last is the time of the page's latest reference read so far, and frame is
+ * where the page lives, or -1. Linear probing with backward shift deletion,
+ * so entries can be dropped once a page is neither in the window nor resident.
+ */
 typedef struct {
-    size_t numBuckets;
-    List** buckets;
-} HashTable;
+    addr_t key;
+    unsigned long last;
+    int frame;
+} WindowEntry;
 
-int hashFunction(HashTable* table, unsigned key) {
-    return key % ((int) table->numBuckets);
-}
+//endregion
 
-List** initBuckets(size_t numBuckets) {
-    List** ret = malloc(sizeof(List*) * numBuckets);
-    int i;
-    for (i = 0; i < numBuckets; i++) {
-        ret[i] = NULL;
-    }
-    return ret;
+// Each instance's s->alg_data
+typedef struct {
+    unsigned long cur_ref;
+
+    unsigned long* frame_key; // Next use of the page held in each frame
+    int* heap;                // Frames ordered as a max-heap on frame_key
+    int* heap_pos;            // Position of each frame in heap, or -1
+    int heap_size;
+
+    // Windowed mode only
+    WindowEntry* window_table;
+    size_t window_capacity;   // Always a power of two
+    size_t window_count;
+    unsigned window_slots;    // opt_window + 1 (the current reference)
+    addr_t* window_page;      // Page referenced at each time in the window
+    unsigned long* window_next; // Next use of that page, if in the window
+    addr_t* frame_page;       // Page held in each frame
+} OptState;
+
+//region FRAME MAX-HEAP
+
+// Returns whether frame a belongs above frame b in the heap. Only pages that
+// are never used again share a key; those go lowest frame first.
+int heapAbove(OptState* o, int a, int b) {
+    return o->frame_key[a] > o->frame_key[b] ||
+           (o->frame_key[a] == o->frame_key[b] && a < b);
 }
 
-HashTable* makeHashTable(size_t numBuckets) {
-    HashTable* ret = malloc(sizeof(HashTable));
-    ret->numBuckets = numBuckets;
-    ret->buckets = initBuckets(numBuckets);
-    return ret;
+void heapSwap(OptState* o, int i, int j) {
+    int tmp = o->heap[i];
+    o->heap[i] = o->heap[j];
+    o->heap[j] = tmp;
+    o->heap_pos[o->heap[i]] = i;
+    o->heap_pos[o->heap[j]] = j;
 }
 
-KeyValuePair* findMatchingPair(List* bucket, unsigned key) {
-    int i;
-    for (i = 0; i < bucket->count; i++) {
-        KeyValuePair* pair = (KeyValuePair*) bucket->contents[i];
-        if (pair->key == key) {
-            return pair;
+void siftUp(OptState* o, int i) {
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!heapAbove(o, o->heap[i], o->heap[parent])) {
+            break;
         }
+        heapSwap(o, i, parent);
+        i = parent;
     }
-    return NULL;
 }
 
-void* hashTableGet(HashTable* table, unsigned key) {
-
-    // Get the hash
-    int hash = hashFunction(table, key);
-
-    // Fetch the appropriate bucket, or abort
-    List* bucket = table->buckets[hash];
-    if (bucket == NULL) {
-        return NULL;
-    }
-
-    // Find the matching KVP, or abort
-    KeyValuePair* matching = findMatchingPair(bucket, key);
-    if (matching == NULL) {
-        return NULL;
+void siftDown(OptState* o, int i) {
+    while (1) {
+        int largest = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < o->heap_size && heapAbove(o, o->heap[left], o->heap[largest])) {
+            largest = left;
+        }
+        if (right < o->heap_size && heapAbove(o, o->heap[right], o->heap[largest])) {
+            largest = right;
+        }
+        if (largest == i) {
+            return;
+        }
+        heapSwap(o, i, largest);
+        i = largest;
     }
-
-    // Get the value of the matching pair
-    return matching->value;
 }
 
-// Sets key to map to value in table.
-// Returns the value overwritten if key is already in table
-void* hashTableSet(HashTable* table, unsigned key, void* value) {
-    size_t HASH_TABLE_BUCKET_SIZE = 5;
-
-    // Fetch the appropriate bucket, or make it if it doesn't exist
-    int hash = hashFunction(table, key);
-    if (table->buckets[hash] == NULL) {
-        table->buckets[hash] = makeList(HASH_TABLE_BUCKET_SIZE);
-    }
-    List* bucket = table->buckets[hash];
-
-    // Find matching KVP, and if one exists modify it
-    KeyValuePair* toModify = findMatchingPair(bucket, key);
-    if (toModify != NULL) {
-        void* ret = toModify->value;
-        toModify->value = value;
-        return ret;
-    }
-
-        // Otherwise insert into the bucket
-    else {
-        KeyValuePair* newPair = makeKeyValuePair(key, value);
-        listAppend(bucket, newPair);
-        return NULL;
-    }
-
-}
-
-void* hashTableRemove(HashTable* table, unsigned key) {
-
-    // Get the hash
-    int hash = hashFunction(table, key);
-
-    // Fetch the appropriate bucket, or abort
-    List* bucket = table->buckets[hash];
-    if (bucket == NULL) {
-        return NULL;
-    }
-
-    // Find the matching KVP or abort
-    KeyValuePair* matching = findMatchingPair(bucket, key);
-    if (matching == NULL) {
-        return NULL;
-    }
-
-    // Delete the KVP from the bucket, and if the bucket is empty delete it
-    listDelete(bucket, matching);
-    if (bucket->count == 0) {
-        destroyList(bucket);
-        table->buckets[hash] = NULL;
-    }
-
-    void* ret = matching->value;
-    free(matching);
-    return ret;
+// Moves frame to its place in the heap after its key changed
+void heapUpdate(OptState* o, int frame) {
+    siftUp(o, o->heap_pos[frame]);
+    siftDown(o, o->heap_pos[frame]);
 }
 
 //endregion
 
-//region BELADY IMPLEMENTATION
-
-int curRef;
-List* pageList;
-HashTable* beladyTable;
-
-// Creates a pointer that points to val
-// This is used to insert into int Lists.
-int* createIntPtr(int val){
-    int* ret = malloc(sizeof(int));
-    *ret = val;
-    return ret;
-}
-
-// Destroys an int pointer. Returns the value that the pointer held.
-// This is used to pop Lists of ints.
-int destroyIntPtr(int* ptr){
-    int ret = *ptr;
-    free(ptr);
-    return ret;
-}
-
-// Creates a pointer that points to val
-// This is used to insert into unsigned Lists.
-unsigned* createUnsignedPtr(unsigned val){
-    unsigned * ret = malloc(sizeof(unsigned));
-    *ret = val;
-    return ret;
-}
-
-// Makes a list of all page numbers appearing in the given trace path
+// Reads the trace and builds next_use with one backward pass over its pages
 // Stops program with an error if file interactions result in an error
-List* makePageList(char* trace_path) {
+void buildNextUse(char* trace_path) {
 
     // Open up the file or fail
-    FILE* file_ptr = fopen(trace_path, "r");
-    if (file_ptr == NULL) {
+    trace_t* trace_ptr = trace_open(trace_path);
+    if (trace_ptr == NULL) {
         perror("Error Opening Trace File");
         exit(1);
     }
 
-    int INIT_LIST_SIZE = 100;
-    List* ret = makeList(INIT_LIST_SIZE);
+    // Load the pages (which carry the PID, so don't fit in next_use)
+    size_t capacity = 1024;
+    addr_t* pages = malloc(capacity * sizeof(addr_t));
+    num_refs = 0;
 
-    // Load the page numbers into the list
+    char type;
     addr_t virtualAddress;
-    while (fscanf(file_ptr, "%*c %lx\n", &virtualAddress) != EOF) {
-        // Find the page number by right shifting (it should now fit into an unsigned value)
-        unsigned pageNum = (unsigned) (virtualAddress >> PAGE_SHIFT);
-        listAppend(ret, (void*) createUnsignedPtr(pageNum));
+    unsigned pid;
+    while (trace_next(trace_ptr, &type, &virtualAddress, &pid)) {
+        if (num_refs == capacity) {
+            capacity *= 2;
+            pages = realloc(pages, capacity * sizeof(addr_t));
+        }
+        pages[num_refs++] = trace_page(pid, virtualAddress);
     }
-
-    // Close file or fail
-    if (fclose(file_ptr) != 0) {
-        destroyList(ret);
-        perror("Error Closing Trace File");
-        exit(1);
+    trace_close(trace_ptr);
+
+    // Walk backwards, remembering the most recent (i.e. next) use of each page
+    next_use = malloc((num_refs > 0 ? num_refs : 1) * sizeof(unsigned));
+    PageTable lastUse;
+    pageTableInit(&lastUse, 1024);
+    unsigned t;
+    for (t = num_refs; t-- > 0;) {
+        next_use[t] = pageTableSwap(&lastUse, pages[t], t);
     }
-
-    return ret;
+    pageTableDestroy(&lastUse);
+    free(pages);
 }
 
-// Inserts a reference time for a given page number into table
-void addBeladyPage(HashTable* table, unsigned pageNum, int time) {
-    size_t LIST_SIZE = 4;
-
-    // Make a list at the page number
-    if (hashTableGet(table, pageNum) == NULL) {
-        hashTableSet(table, pageNum, (void*) makeList(LIST_SIZE));
-    }
+//region LOOKAHEAD WINDOW
 
-    // Put the reference time into the list
-    List* list = (List*) hashTableGet(table, pageNum);
-    listAppend(list, (void*) createIntPtr(time));
+size_t windowHome(OptState* o, addr_t page) {
+    return (size_t) (page * 0x9E3779B97F4A7C15ull >> 20) & (o->window_capacity - 1);
 }
 
-// Turns a trace file into a hash table that maps
-// (page numbers) to (list of DECREASING reference times)
-HashTable* makeBeladyTable() {
+// Returns the slot for page, which is empty (key 0) if page is not present
+size_t windowSlot(OptState* o, addr_t page) {
+    size_t mask = o->window_capacity - 1;
+    size_t slot = windowHome(o, page);
+    while (o->window_table[slot].key != 0 && o->window_table[slot].key != page + 1) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
 
-    // Instantiate a hash table proportional
-    // in size to number of frames in memory
-    int BUCKET_SIZE = 5;
-    HashTable* ret = makeHashTable((size_t) memsize / BUCKET_SIZE);
+void windowGrow(OptState* o) {
+    WindowEntry* old = o->window_table;
+    size_t old_capacity = o->window_capacity;
+    size_t i;
 
-    // Create lists of DECREASING reference times for every
-    int i;
-    for (i = 0; i < pageList->count; i++){
-        int time = (int) pageList->count - i - 1;
-        unsigned* pageNumPtr = (unsigned*) pageList->contents[time];
-        addBeladyPage(ret, *pageNumPtr, time);
+    o->window_capacity *= 2;
+    o->window_table = calloc(o->window_capacity, sizeof(WindowEntry));
+    for (i = 0; i < old_capacity; i++) {
+        if (old[i].key != 0) {
+            o->window_table[windowSlot(o, old[i].key - 1)] = old[i];
+        }
     }
-
-    return ret;
+    free(old);
 }
 
+// Returns the entry for page, adding it if needed
+WindowEntry* windowLookup(OptState* o, addr_t page) {
+    size_t slot = windowSlot(o, page);
+    if (o->window_table[slot].key == 0) {
+        if ((o->window_count + 1) * 2 > o->window_capacity) {
+            windowGrow(o);
+            slot = windowSlot(o, page);
+        }
+        o->window_table[slot].key = page + 1;
+        o->window_table[slot].last = FAR_KEY;
+        o->window_table[slot].frame = -1;
+        o->window_count++;
+    }
+    return &o->window_table[slot];
+}
 
-// Pops the next time a page will be referenced from it's reference time list
-// If no such page exists, returns -1
-int popNextRefTime(unsigned pageNum) {
+void windowRemove(OptState* o, addr_t page) {
+    size_t mask = o->window_capacity - 1;
+    size_t hole = windowSlot(o, page);
+    size_t i = hole;
 
-    // Get list of reference times
-    List* refTimes = (List*) hashTableGet(beladyTable, pageNum);
+    assert(o->window_table[hole].key != 0);
+    o->window_table[hole].key = 0;
+    o->window_count--;
 
-    // Abort indicating we'll never see the page number again
-    if (refTimes == NULL) {
-        return -1;
+    // Pull back later entries of the probe run that can't be found past the hole
+    while (1) {
+        i = (i + 1) & mask;
+        if (o->window_table[i].key == 0) {
+            return;
+        }
+        size_t home = windowHome(o, o->window_table[i].key - 1);
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            o->window_table[hole] = o->window_table[i];
+            o->window_table[i].key = 0;
+            hole = i;
+        }
     }
+}
 
-    // Pop the value off the list
-    int* popped = (int*) listPop(refTimes);
-
-    // Remove and destroy empty lists
-    if (refTimes->count == 0){
-        hashTableRemove(beladyTable, pageNum);
-        destroyList(refTimes);
+// Called by the trace for each reference as it enters the window
+void windowPush(void* arg, char type, addr_t vaddr, unsigned pid,
+                unsigned long time) {
+    OptState* o = arg;
+    addr_t page = trace_page(pid, vaddr);
+    unsigned slot = (unsigned) (time % o->window_slots);
+    WindowEntry* entry = windowLookup(o, page);
+
+    o->window_page[slot] = page;
+    o->window_next[slot] = FAR_KEY;
+
+    if (entry->last != FAR_KEY && entry->last >= o->cur_ref) {
+        // Link the previous occurrence, still waiting in the window, to this one
+        o->window_next[entry->last % o->window_slots] = time;
+    } else if (entry->frame != -1) {
+        // Resident page whose next use was unknown until now
+        o->frame_key[entry->frame] = time;
+        heapUpdate(o, entry->frame);
     }
-
-    return destroyIntPtr(popped);
+    entry->last = time;
 }
 
-// Returns the next time a page will be referenced from it's reference time list
-// If no such page exists, returns -1
-int peekNextRefTime(unsigned pageNum) {
+void windowInit(struct sim* s, OptState* o) {
+    o->window_slots = opt_window + 1;
+    o->window_page = malloc(o->window_slots * sizeof(addr_t));
+    o->window_next = malloc(o->window_slots * sizeof(unsigned long));
+    o->frame_page = malloc(s->memsize * sizeof(addr_t));
+    o->window_capacity = 1024;
+    o->window_count = 0;
+    o->window_table = calloc(o->window_capacity, sizeof(WindowEntry));
 
-    // Get list of reference times
-    List* refTimes = (List*) hashTableGet(beladyTable, pageNum);
-
-    // Abort indicating we'll never see the page number again
-    if (refTimes == NULL) {
-        return -1;
-    }
-
-    // Look at the last value in the list,
-    // it will be the smallest for this page number
-    int* last = (int*) listPeek(refTimes);
-    return *last;
+    trace_add_lookahead(s->trace, opt_window, windowPush, o);
 }
 
 //endregion
 
-
 /* Page to evict is chosen using the optimal (aka MIN) algorithm. 
  * Returns the page frame number (which is also the index in the coremap)
  * for the page that is to be evicted.
  */
-int opt_evict() {
-
-    int victim = 0;
-    int maxRefTime = -1;
-
-    // Find the page that won't be referenced in the longest time
-    int i;
-    for (i = 0; i < memsize; i++){
-        struct frame f = coremap[i];
-
-        int nextRefTime = peekNextRefTime(f.page);
-
-        // We never see the page again, so get rid of the frame
-        if (nextRefTime == -1){
-            return i;
-        }
-
-        // Update to new victim
-        if (maxRefTime < nextRefTime){
-            victim = i;
-            maxRefTime = nextRefTime;
+int opt_evict(struct sim* s) {
+    OptState* o = s->alg_data;
+
+    // The frame whose page is used furthest in the future is on top.
+    // It stays in the heap and is re-keyed when its new page is referenced.
+    assert(o->heap_size > 0);
+    int victim = o->heap[0];
+
+    if (opt_window != 0) {
+        WindowEntry* entry = windowLookup(o, o->frame_page[victim]);
+        entry->frame = -1;
+        if (entry->last < o->cur_ref) {
+            windowRemove(o, o->frame_page[victim]);
         }
     }
-
     return victim;
 }
 
@@ -463,31 +379,61 @@ int opt_evict() {
  * needed by the opt algorithm.
  * Input: The page table entry for the page that is being accessed.
  */
-void opt_ref(pgtbl_entry_t* p) {
+void opt_ref(struct sim* s, pgtbl_entry_t* p) {
+    OptState* o = s->alg_data;
 
     // Figure out the frame of this page
-    unsigned frameNumber = (p->frame >> PAGE_SHIFT);
-
-    // Figure out which page is being referenced
-    unsigned* pageNumberPtr = (unsigned*) pageList->contents[curRef];
-
-    // Have the frame refer to this page number
-    struct frame* f = &(coremap[frameNumber]);
-    f->page = *pageNumberPtr;
+    int frameNumber = (int) pte_frame(p);
+
+    // The frame's page is next needed at the next use of this reference
+    if (opt_window == 0) {
+        assert(o->cur_ref < num_refs);
+        unsigned next = next_use[o->cur_ref];
+        o->frame_key[frameNumber] = next == NEVER ? FAR_KEY : next;
+    } else {
+        unsigned slot = (unsigned) (o->cur_ref % o->window_slots);
+        WindowEntry* entry = windowLookup(o, o->window_page[slot]);
+        entry->frame = frameNumber;
+        o->frame_page[frameNumber] = o->window_page[slot];
+        o->frame_key[frameNumber] = o->window_next[slot] != FAR_KEY ?
+                                    o->window_next[slot] : FAR_KEY - o->cur_ref;
+    }
 
-    // Pop off the next occurrence for this page
-    popNextRefTime(*pageNumberPtr);
+    if (o->heap_pos[frameNumber] == -1) {
+        o->heap[o->heap_size] = frameNumber;
+        o->heap_pos[frameNumber] = o->heap_size++;
+    }
+    heapUpdate(o, frameNumber);
 
     // Ensure that the frames and pages are kept in sync
-    curRef += 1;
+    o->cur_ref += 1;
 }
 
 /* Initializes any data structures needed for this
  * replacement algorithm.
  */
-void opt_init() {
-    curRef = 0;
-    pageList = makePageList(tracefile);
-    beladyTable = makeBeladyTable();
-}
+void opt_init(struct sim* s) {
+    int i;
+    OptState* o = calloc(1, sizeof(OptState));
+
+    o->cur_ref = 0;
+    o->frame_key = malloc(s->memsize * sizeof(unsigned long));
+    o->heap = malloc(s->memsize * sizeof(int));
+    o->heap_pos = malloc(s->memsize * sizeof(int));
+    o->heap_size = 0;
+    for (i = 0; i < s->memsize; i++) {
+        o->heap_pos[i] = -1;
+    }
+    s->alg_data = o;
 
+    // A piped trace can only be read once, so it must be windowed
+    if (tracefile == NULL && opt_window == 0) {
+        opt_window = OPT_DEFAULT_WINDOW;
+    }
+
+    if (opt_window != 0) {
+        windowInit(s, o);
+    } else if (next_use == NULL) {
+        buildNextUse(tracefile);
+    }
+}
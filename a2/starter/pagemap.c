@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "pagemap.h"
+
+static unsigned pagemap_hash(PageMap* m, pgtbl_entry_t* page) {
+    return (unsigned) (((uintptr_t) page >> 3) * 0x9E3779B97F4A7C15UL >> 32) &
+           (m->nbuckets - 1);
+}
+
+PageMap* pagemap_create(int nlists, int capacity) {
+    PageMap* m = malloc(sizeof(PageMap));
+    int i;
+
+    m->nlists = nlists;
+    m->nodes = malloc((nlists + capacity) * sizeof(PageNode));
+    m->len = calloc(nlists, sizeof(int));
+
+    // Each list starts out as just its head, linked to itself
+    for (i = 0; i < nlists; i++) {
+        m->nodes[i].page = NULL;
+        m->nodes[i].list = i;
+        m->nodes[i].prev = m->nodes[i].next = i;
+    }
+
+    m->free = PM_NONE;
+    for (i = nlists + capacity - 1; i >= nlists; i--) {
+        m->nodes[i].next = m->free;
+        m->free = i;
+    }
+
+    for (m->nbuckets = 1; m->nbuckets < (unsigned) capacity; m->nbuckets *= 2);
+    m->buckets = malloc(m->nbuckets * sizeof(int));
+    for (i = 0; i < (int) m->nbuckets; i++) {
+        m->buckets[i] = PM_NONE;
+    }
+    return m;
+}
+
+int pagemap_find(PageMap* m, pgtbl_entry_t* page) {
+    int n = m->buckets[pagemap_hash(m, page)];
+    while (n != PM_NONE && m->nodes[n].page != page) {
+        n = m->nodes[n].hnext;
+    }
+    return n;
+}
+
+// Links node in between prev and prev's next, on prev's list
+static void link_after(PageMap* m, int node, int prev) {
+    PageNode* n = &m->nodes[node];
+    n->list = m->nodes[prev].list;
+    n->prev = prev;
+    n->next = m->nodes[prev].next;
+    m->nodes[n->next].prev = node;
+    m->nodes[prev].next = node;
+    m->len[n->list]++;
+}
+
+static void unlink_node(PageMap* m, int node) {
+    PageNode* n = &m->nodes[node];
+    m->nodes[n->prev].next = n->next;
+    m->nodes[n->next].prev = n->prev;
+    m->len[n->list]--;
+}
+
+int pagemap_add(PageMap* m, pgtbl_entry_t* page, int frame, int list) {
+    int node = m->free;
+    unsigned b = pagemap_hash(m, page);
+
+    assert(node != PM_NONE);
+    m->free = m->nodes[node].next;
+
+    m->nodes[node].page = page;
+    m->nodes[node].frame = frame;
+    m->nodes[node].flags = 0;
+    m->nodes[node].hnext = m->buckets[b];
+    m->buckets[b] = node;
+    link_after(m, node, list);
+    return node;
+}
+
+void pagemap_move(PageMap* m, int node, int list) {
+    unlink_node(m, node);
+    link_after(m, node, list);
+}
+
+void pagemap_move_before(PageMap* m, int node, int pos) {
+    if (node == pos) {
+        return;
+    }
+    unlink_node(m, node);
+    link_after(m, node, m->nodes[pos].prev);
+}
+
+void pagemap_remove(PageMap* m, int node) {
+    int* link = &m->buckets[pagemap_hash(m, m->nodes[node].page)];
+
+    while (*link != node) {
+        link = &m->nodes[*link].hnext;
+    }
+    *link = m->nodes[node].hnext;
+
+    unlink_node(m, node);
+    m->nodes[node].page = NULL;
+    m->nodes[node].next = m->free;
+    m->free = node;
+}
+
+int pagemap_tail(PageMap* m, int list) {
+    int tail = m->nodes[list].prev;
+    return tail == list ? PM_NONE : tail;
+}
+
+int pagemap_next(PageMap* m, int node) {
+    int next = m->nodes[node].next;
+    if (next < m->nlists) {
+        next = m->nodes[next].next;
+    }
+    return next < m->nlists ? PM_NONE : next;
+}
@@ -0,0 +1,59 @@
+#ifndef __PAGEMAP_H__
+#define __PAGEMAP_H__
+
+#include "pagetable.h"
+
+/* Page bookkeeping shared by the ARC, 2Q and CLOCK-Pro policies.
+ *
+ * A PageMap holds a fixed pool of nodes, one per page a policy is tracking,
+ * whether resident or only remembered (a "ghost"). Nodes are found by page
+ * in O(1) expected time through a hash table, and each node is on one of
+ * the map's lists, which are circular and doubly linked so any node can be
+ * moved or removed in O(1). Pages are identified by their page table entry,
+ * which stays put for the life of the simulation.
+ */
+#define PM_NONE (-1)
+
+typedef struct {
+    pgtbl_entry_t* page;
+    int frame;          // Frame holding the page, or PM_NONE for a ghost
+    int list;           // List the node is on
+    int prev, next;     // Neighbours on that list
+    int hnext;          // Next node in the same hash bucket
+    int flags;          // Free for the policy to use
+} PageNode;
+
+typedef struct {
+    PageNode* nodes;    // The first nlists nodes are the lists' heads
+    int nlists;
+    int* len;           // Nodes on each list
+    int free;           // Unused nodes, chained through next
+    int* buckets;
+    unsigned nbuckets;  // Always a power of two
+} PageMap;
+
+// A map with nlists lists and room for capacity pages
+extern PageMap* pagemap_create(int nlists, int capacity);
+
+// The node for page, or PM_NONE
+extern int pagemap_find(PageMap* m, pgtbl_entry_t* page);
+
+// Adds page at the head (most recent end) of list and returns its node
+extern int pagemap_add(PageMap* m, pgtbl_entry_t* page, int frame, int list);
+
+// Moves node to the head of list
+extern void pagemap_move(PageMap* m, int node, int list);
+
+// Moves node to just before pos, on pos' list
+extern void pagemap_move_before(PageMap* m, int node, int pos);
+
+extern void pagemap_remove(PageMap* m, int node);
+
+// The node at the tail (least recent end) of list, or PM_NONE
+extern int pagemap_tail(PageMap* m, int list);
+
+// The node after node on its list (towards the tail), skipping the head;
+// PM_NONE if the list is empty
+extern int pagemap_next(PageMap* m, int node);
+
+#endif // __PAGEMAP_H__
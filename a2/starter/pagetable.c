@@ -1,121 +1,400 @@
 #include <assert.h>
 #include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
 #include "sim.h"
 #include "pagetable.h"
+#include "tlb.h"
+#include "huge.h"
+#include "prefetch.h"
+#include "evlog.h"
+
+// pte_set() and pte_clear() for entries that other threads may be reading,
+// or marking referenced or dirty, during concurrent replay
+static inline void entry_set(struct sim* s, pgtbl_entry_t* p,
+                             unsigned flags) {
+    if (s->concurrent) {
+        pte_set_atomic(p, flags);
+    } else {
+        pte_set(p, flags);
+    }
+}
+
+static inline void entry_clear(struct sim* s, pgtbl_entry_t* p,
+                               unsigned flags) {
+    if (s->concurrent) {
+        pte_clear_atomic(p, flags);
+    } else {
+        pte_clear(p, flags);
+    }
+}
+
+// Records an event for proc's page at vaddr, if there is an event log (-E)
+static inline __attribute__((always_inline))
+void log_event(struct sim* s, unsigned type, struct proc* proc, addr_t vaddr,
+               unsigned frame) {
+    if (s->evlog != NULL) {
+        uint64_t page = trace_page(proc->pid, vaddr);
+        if (evlog_sampled(s->evlog, page)) {
+            evlog_put(s->evlog, type, page, frame);
+        }
+    }
+}
+
+// Records a hit on a page in frame, which the event log has already seen
+// go into it. Unless the log is sampled the page isn't needed at all.
+static inline __attribute__((always_inline))
+void log_hit(struct sim* s, struct proc* proc, addr_t vaddr, unsigned frame) {
+    struct evlog* l = s->evlog;
+    if (l != NULL && (l->sample_below == UINT64_MAX ||
+                      evlog_sampled(l, trace_page(proc->pid, vaddr)))) {
+        evlog_put_hit(l, frame);
+    }
+}
+
+/*
+ * Writes the page in frame to swap if needed, and updates its pagetable
+ * entry to indicate that the virtual page is no longer in (simulated)
+ * physical memory. The frame is left for the caller to reuse or free.
+ */
+static void evict_page(struct sim* s, int frame_number) {
+    struct frame* victim = &s->coremap[frame_number];
+    pgtbl_entry_t* victim_entry = victim->pte;
+
+    // VALID = 0 (evicted page cannot be valid). Once it is clear no thread
+    // can pin the frame in pin_physpage(), so wait out any that already have.
+    entry_clear(s, victim_entry, PG_VALID);
+    while (__atomic_load_n(&victim->pins, __ATOMIC_SEQ_CST) != 0) {
+        sched_yield();
+    }
+
+    // Dirty = 1 -> page is modified and must be written to disk
+    if (pte_test(victim_entry, PG_DIRTY)) {
+        pte_set_swap_off(victim_entry, swap_pageout(
+                s, (unsigned) frame_number,
+                pte_swap_off(victim_entry)
+        ));
+        s->evict_dirty_count++;
+        victim->proc->evict_dirty_count++;
+        cost_evict(&s->cost, 1);
+        log_event(s, EV_SWAP_OUT, victim->proc, victim->vaddr, frame_number);
+        log_event(s, EV_EVICT_DIRTY, victim->proc, victim->vaddr, frame_number);
+    } else {
+        s->evict_clean_count++;
+        victim->proc->evict_clean_count++;
+        cost_evict(&s->cost, 0);
+        log_event(s, EV_EVICT_CLEAN, victim->proc, victim->vaddr, frame_number);
+    }
+    victim->proc->resident--;
+
+    if (pte_test(victim_entry, PG_PREFETCH)) {
+        s->prefetch_wasted_count++;
+        entry_clear(s, victim_entry, PG_PREFETCH);
+    }
+
+    // Set bits to appropriate values
+    entry_clear(s, victim_entry, PG_REF); // REFERENCE = 0 (evicted cannot be in use)
+    entry_set(s, victim_entry, PG_ONSWAP); // ONSWAP = 1 (evicted is now on swap)
 
-// The top-level page table (also known as the 'page directory')
-pgdir_entry_t pgdir[PTRS_PER_PGDIR];
+    // The TLB must not keep translating to a frame the page has left.
+    // It only holds the current process' translations.
+    if (s->tlb != NULL && victim->proc == s->proc) {
+        tlb_invalidate(s->tlb, victim->vaddr);
+    }
 
-// Counters for various events.
-// Your code must increment these when the related events occur.
-int hit_count = 0;
-int miss_count = 0;
-int ref_count = 0;
-int evict_clean_count = 0;
-int evict_dirty_count = 0;
+    if (s->alg->on_evict != NULL) {
+        s->alg->on_evict(s, frame_number, victim_entry);
+    }
+}
 
 /*
- * Allocates a frame to be used for the virtual page represented by p.
+ * Allocates a frame to be used for the virtual page vaddr, represented by p.
  * If all frames are in use, calls the replacement algorithm's evict_fcn to
- * select a victim frame.  Writes victim to swap if needed, and updates 
- * pagetable entry for victim to indicate that virtual page is no longer in
- * (simulated) physical memory.
+ * select a victim frame, and evicts its page.
  *
- * Counters for evictions should be updated appropriately in this function.
+ * Free frames are popped off s->free_frames, so finding one is O(1), and
+ * once memory is full we go straight to the replacement algorithm.
+ *
+ * Counters for evictions are updated by evict_page().
  */
-int allocate_frame(pgtbl_entry_t* p) {
-    int i;
+int allocate_frame(struct sim* s, pgtbl_entry_t* p, addr_t vaddr) {
+    struct frame* coremap = s->coremap;
 
     // Renaming frame -> frame_number because frame is a type
     int frame_number = -1;
-    for (i = 0; i < memsize; i++) {
-        if (!coremap[i].in_use) {
-            frame_number = i;
-            break;
-        }
+    if (s->nfree > 0) {
+        frame_number = s->free_frames[--s->nfree];
+        assert(!coremap[frame_number].in_use);
     }
 
     if (frame_number == -1) { // Didn't find a free page.
         // Call replacement algorithm's evict function to select victim
-        frame_number = evict_fcn();
+        s->fault_pte = p;
+        frame_number = s->alg->evict(s);
 
         // All frames were in use, so victim frame must hold some page
-        // Write victim page to swap, if needed, and update pagetable
-        // IMPLEMENTATION NEEDED
-
-        // Grab the victim
-        struct frame* victim = &coremap[frame_number];
-        pgtbl_entry_t* victim_entry = victim->pte;
-
-        // Dirty = 1 -> page is modified and must be written to disk
-        if (coremap[frame_number].pte->frame & PG_DIRTY) {
-            coremap[frame_number].pte->swap_off = swap_pageout(
-                    (unsigned) frame_number,
-                    (int) victim_entry->swap_off
-            );
-            evict_dirty_count++;
-        } else {
-            evict_clean_count++;
-        }
-
-        // Set bits to appropriate values
-        victim_entry->frame &= ~PG_VALID; // VALID = 0 (evicted page cannot be valid)
-        victim_entry->frame &= ~PG_REF; // REFERENCE = 0 (evicted cannot be in use)
-        victim_entry->frame |= PG_ONSWAP; // ONSWAP = 1 (evicted is now on swap)
+        evict_page(s, frame_number);
     }
 
     // Record information for virtual page that will now be stored in frame
     coremap[frame_number].in_use = 1;
     coremap[frame_number].pte = p;
+    coremap[frame_number].vaddr = vaddr;
+    coremap[frame_number].proc = s->proc;
+    s->proc->resident++;
+
+    if (s->alg->on_alloc != NULL) {
+        s->alg->on_alloc(s, frame_number, p);
+    }
 
     return frame_number;
 }
 
 /*
- * Initializes the top-level pagetable.
+ * Evicts the page in frame and puts the frame back on the free stack. Used
+ * by replacement algorithms that shrink a process' resident set on their
+ * own instead of waiting for memory to fill up. The page must not be the
+ * one being referenced.
+ */
+void release_frame(struct sim* s, int frame) {
+    assert(s->coremap[frame].in_use);
+    evict_page(s, frame);
+    s->coremap[frame].in_use = 0;
+    s->free_frames[s->nfree++] = frame;
+}
+
+int pgtbl_levels = 2;
+
+static const struct pgtbl_layout pgtbl_layouts[] = {
+        {2, VADDR_BITS, {PGDIR_SHIFT, PAGE_SHIFT},
+                {PTRS_PER_PGDIR, PTRS_PER_PGTBL}},
+        {3, 39, {30, 21, PAGE_SHIFT}, {512, 512, 512}},
+        {4, 48, {39, 30, 21, PAGE_SHIFT}, {512, 512, 512, 512}},
+};
+
+const struct pgtbl_layout* find_pgtbl_layout(int levels) {
+    unsigned i;
+    for (i = 0; i < sizeof(pgtbl_layouts) / sizeof(pgtbl_layouts[0]); i++) {
+        if (pgtbl_layouts[i].levels == levels) {
+            return &pgtbl_layouts[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Every directory entry starts out pointing at a shared "all invalid" table
+ * instead of being empty, so walks never have to check directory entries.
+ * invalid_table[0] is a table of invalid PTEs, and the entries of
+ * invalid_table[h] point at invalid_table[h - 1], so a table with h levels
+ * below it is initialized by copying invalid_table[h]. They are mapped
+ * read-only: a real table is only allocated (see init_table) when a fault
+ * needs to write a PTE in that region, and a stray write to a sentinel
+ * crashes instead of corrupting every process' view of untouched memory.
+ */
+#define INVALID_TABLE_BYTES (MAX_PTRS_PER_TABLE * sizeof(pgtbl_entry_t))
+
+static void* invalid_table[MAX_PGTBL_LEVELS];
+static pthread_once_t invalid_table_once = PTHREAD_ONCE_INIT;
+
+static void init_invalid_tables(void) {
+    int h, i;
+
+    for (h = 0; h < MAX_PGTBL_LEVELS; h++) {
+        invalid_table[h] = mmap(NULL, INVALID_TABLE_BYTES,
+                                PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (invalid_table[h] == MAP_FAILED) {
+            perror("Failed to map invalid page table");
+            exit(1);
+        }
+        for (i = 0; i < MAX_PTRS_PER_TABLE; i++) {
+            if (h == 0) {
+                pgtbl_entry_t* pgtbl = invalid_table[h];
+                pte_set_frame(&pgtbl[i], 0); // sets all bits, including valid, to zero
+                pte_set_swap_off(&pgtbl[i], INVALID_SWAP);
+            } else {
+                // The valid bit stays 0, which marks the entry as not
+                // having a table of its own yet.
+                pgdir_entry_t* dir = invalid_table[h];
+                dir[i].pde = (uintptr_t) invalid_table[h - 1];
+            }
+        }
+        if (mprotect(invalid_table[h], INVALID_TABLE_BYTES, PROT_READ) != 0) {
+            perror("Failed to protect invalid page table");
+            exit(1);
+        }
+    }
+}
+
+// Size in bytes of a table at the given depth (the pgdir is depth 0)
+static size_t table_bytes(const struct pgtbl_layout* l, int depth) {
+    return l->entries[depth] * (depth == l->levels - 1 ?
+                                sizeof(pgtbl_entry_t) : sizeof(pgdir_entry_t));
+}
+
+// Creates process pid with an empty address space
+static struct proc* create_process(struct sim* s, unsigned pid) {
+    struct proc* p = calloc(1, sizeof(struct proc));
+
+    p->pid = pid;
+    p->pgdir = malloc(table_bytes(s->layout, 0));
+    if (p->pgdir == NULL) {
+        perror("Failed to allocate page directory");
+        exit(1);
+    }
+    s->pgtbl_bytes += table_bytes(s->layout, 0);
+
+    // Point every entry at the shared invalid tables
+    memcpy(p->pgdir, invalid_table[s->layout->levels - 1],
+           table_bytes(s->layout, 0));
+
+    s->procs = realloc(s->procs, (s->nprocs + 1) * sizeof(struct proc*));
+    s->procs[s->nprocs++] = p;
+    return p;
+}
+
+/*
+ * Initializes the page tables.
  * This function is called once at the start of the simulation.
- * For the simulation, there is a single "process" whose reference trace is 
- * being simulated, so there is just one top-level page table (page directory).
- * To keep things simple, we use a global array of 'page directory entries'.
- *
- * In a real OS, each process would have its own page directory, which would
- * need to be allocated and initialized as part of process creation.
+ * Each process in the trace gets its own top-level page table (page
+ * directory) when it first appears, just as a real OS allocates one as
+ * part of process creation. Traces without PIDs are all from process 0,
+ * which starts out as the current process.
  */
-void init_pagetable() {
+void init_pagetable(struct sim* s) {
+    pthread_once(&invalid_table_once, init_invalid_tables);
+
+    s->layout = find_pgtbl_layout(pgtbl_levels);
+    assert(s->layout != NULL);
+
+    s->pgtbl_bytes = 0;
+    s->proc = create_process(s, 0);
+    s->pgdir = s->proc->pgdir;
+}
+
+/*
+ * A context switch. Processes are few, so they are found by linear search;
+ * it only happens when the PID changes from one reference to the next.
+ * TLB entries carry no address space tag, so the TLB is flushed.
+ */
+void switch_process(struct sim* s, unsigned pid) {
+    struct proc* p = NULL;
     int i;
-    // Set all entries in top-level pagetable to 0, which ensures valid
-    // bits are all 0 initially.
-    for (i = 0; i < PTRS_PER_PGDIR; i++) {
-        pgdir[i].pde = 0;
+
+    for (i = 0; i < s->nprocs; i++) {
+        if (s->procs[i]->pid == pid) {
+            p = s->procs[i];
+            break;
+        }
+    }
+    if (p == NULL) {
+        p = create_process(s, pid);
+    }
+    s->proc = p;
+    s->pgdir = p->pgdir;
+    if (s->tlb != NULL) {
+        tlb_flush(s->tlb);
+    }
+}
+
+// Frees every table below dir, a directory at the given depth
+static void destroy_table(const struct pgtbl_layout* l, pgdir_entry_t* dir,
+                          int depth) {
+    unsigned i;
+    for (i = 0; i < l->entries[depth]; i++) {
+        if (dir[i].pde & PG_VALID) {
+            pgdir_entry_t* child = (pgdir_entry_t*) (dir[i].pde & PAGE_MASK);
+            if (depth + 1 < l->levels - 1) {
+                destroy_table(l, child, depth + 1);
+            }
+            free(child);
+        }
     }
 }
 
-// For simulation, we get second-level pagetables from ordinary memory
-pgdir_entry_t init_second_level() {
+// Frees every process' page directory and the tables it points to
+void destroy_pagetable(struct sim* s) {
     int i;
+    for (i = 0; i < s->nprocs; i++) {
+        destroy_table(s->layout, s->procs[i]->pgdir, 0);
+        free(s->procs[i]->pgdir);
+        free(s->procs[i]->alg_data);
+        free(s->procs[i]);
+    }
+    free(s->procs);
+    s->procs = NULL;
+    s->nprocs = 0;
+    s->proc = NULL;
+    s->pgdir = NULL;
+}
+
+// For simulation, we get lower-level pagetables from ordinary memory
+pgdir_entry_t init_table(struct sim* s, int depth) {
     pgdir_entry_t new_entry;
-    pgtbl_entry_t* pgtbl;
+    void* table;
+    size_t len = table_bytes(s->layout, depth);
 
     // Allocating aligned memory ensures the low bits in the pointer must
     // be zero, so we can use them to store our status bits, like PG_VALID
-    if (posix_memalign((void**) &pgtbl, PAGE_SIZE,
-                       PTRS_PER_PGTBL * sizeof(pgtbl_entry_t)) != 0) {
+    if (posix_memalign(&table, PAGE_SIZE, len) != 0) {
         perror("Failed to allocate aligned memory for page table");
         exit(1);
     }
 
-    // Initialize all entries in second-level pagetable
-    for (i = 0; i < PTRS_PER_PGTBL; i++) {
-        pgtbl[i].frame = 0; // sets all bits, including valid, to zero
-        pgtbl[i].swap_off = INVALID_SWAP;
-    }
+    // Initialize all entries in the new table from the invalid one
+    memcpy(table, invalid_table[s->layout->levels - 1 - depth], len);
+    s->pgtbl_bytes += len;
 
-    // Mark the new page directory entry as valid
-    new_entry.pde = (uintptr_t) pgtbl | PG_VALID;
+    // Mark the new directory entry as valid
+    new_entry.pde = (uintptr_t) table | PG_VALID;
 
     return new_entry;
 }
 
+/*
+ * Points entry, still invalid, at a new table for the given depth. The
+ * table is filled in before a CAS publishes it, so threads walking without
+ * the fault lock (pin_physpage()) see either the invalid table or all of
+ * the new one. If another thread installed a table first, ours is freed.
+ */
+static void install_table(struct sim* s, pgdir_entry_t* entry, int depth) {
+    uintptr_t expected = entry->pde;
+    pgdir_entry_t table = init_table(s, depth);
+
+    if (!__atomic_compare_exchange_n(&entry->pde, &expected, table.pde, 0,
+                                     __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+        free((void*) (table.pde & PAGE_MASK));
+        s->pgtbl_bytes -= table_bytes(s->layout, depth);
+    }
+}
+
+/*
+ * Walks the page table down to the entry for vaddr. Regions that have never
+ * faulted resolve to an entry in invalid_table[0], unless alloc is set, in
+ * which case real tables are installed along the way so that the returned
+ * entry can be written. *pmd is set to the last directory entry on the way.
+ */
+static pgtbl_entry_t* walk_pagetable(struct sim* s, addr_t vaddr, int alloc,
+                                     pgdir_entry_t** pmd) {
+    const struct pgtbl_layout* l = s->layout;
+    pgdir_entry_t* dir = s->pgdir;
+    int d;
+
+    for (d = 0; d < l->levels - 1; d++) {
+        pgdir_entry_t* entry = &dir[(vaddr >> l->shift[d]) &
+                                    (l->entries[d] - 1)];
+        if (alloc && !(entry->pde & PG_VALID)) {
+            install_table(s, entry, d + 1);
+        }
+        dir = (pgdir_entry_t*) (entry->pde & PAGE_MASK);
+        *pmd = entry;
+    }
+    return &((pgtbl_entry_t*) dir)[(vaddr >> PAGE_SHIFT) &
+                                   (l->entries[d] - 1)];
+}
+
 /* 
  * Initializes the content of a (simulated) physical memory frame when it 
  * is first allocated for some virtual address.  Just like in a real OS,
@@ -126,9 +405,9 @@ pgdir_entry_t init_second_level() {
  * page frame to help with error checking.
  *
  */
-void init_frame(int frame, addr_t vaddr) {
+void init_frame(struct sim* s, int frame, addr_t vaddr) {
     // Calculate pointer to start of frame in (simulated) physical memory
-    char* mem_ptr = &physmem[frame * SIMPAGESIZE];
+    char* mem_ptr = &s->physmem[frame * SIMPAGESIZE];
     // Calculate pointer to location in page where we keep the vaddr
     addr_t* vaddr_ptr = (addr_t*) (mem_ptr + sizeof(int));
 
@@ -138,6 +417,62 @@ void init_frame(int frame, addr_t vaddr) {
     return;
 }
 
+/*
+ * Allocates a frame for the page at vaddr, whose entry is p, and fills it
+ * from swap if is_swapped, or with zeros. The entry is left pointing at the
+ * frame with its status bits cleared, so the page isn't valid yet.
+ */
+static void fault_in(struct sim* s, pgtbl_entry_t* p, addr_t vaddr,
+                     int is_swapped) {
+    int frame_number = allocate_frame(s, p, vaddr);
+
+    // Put the frame into the entry, clearing the old status bits
+    pte_set_frame(p, (unsigned) frame_number);
+
+    if (is_swapped) {
+        swap_pagein(s, frame_number, pte_swap_off(p)); // Get page off swap
+        log_event(s, EV_SWAP_IN, s->proc, vaddr, frame_number);
+        // Page is now off the swap -> ONSWAP = 0 (cleared above)
+    } else {
+        init_frame(s, frame_number, vaddr); // need to make the actual frame
+        entry_set(s, p, PG_DIRTY); // Page is in memory, still needs to be swapped -> DIRTY = 1
+        pte_set_swap_off(p, INVALID_SWAP); // Page still needs a swap offset
+    }
+}
+
+/*
+ * Faults in the pages the prefetcher predicts after the current process
+ * missed on vaddr, before vaddr's own page gets a frame. Predictions that
+ * are resident, in a huge region or outside the address space are skipped.
+ * Prefetched pages are marked PG_PREFETCH rather than PG_REF and handed to
+ * the replacement algorithm's ref_fcn, like a reference that doesn't count.
+ * Their reads overlap the demand fault's, so only evictions they cause add
+ * to the cost model.
+ */
+static void prefetch_pages(struct sim* s, addr_t vaddr) {
+    addr_t pages[PREFETCH_MAX_DEGREE];
+    pgdir_entry_t* pmd = NULL;
+    int i, n = prefetch_predict(s->prefetch, s->proc->pid, vaddr, pages);
+
+    for (i = 0; i < n; i++) {
+        if (pages[i] >> s->layout->vaddr_bits ||
+            pages[i] >> PAGE_SHIFT == vaddr >> PAGE_SHIFT) {
+            continue;
+        }
+        pgtbl_entry_t* p = walk_pagetable(s, pages[i], 0, &pmd);
+        if ((pmd->pde & PDE_HUGE) || pte_test(p, PG_VALID)) {
+            continue;
+        }
+        if ((uintptr_t) p - (uintptr_t) invalid_table[0] < INVALID_TABLE_BYTES) {
+            p = walk_pagetable(s, pages[i], 1, &pmd);
+        }
+        fault_in(s, p, pages[i], pte_test(p, PG_ONSWAP));
+        entry_set(s, p, PG_VALID | PG_PREFETCH);
+        s->alg->ref(s, p);
+        s->prefetch_count++;
+    }
+}
+
 /*
  * Locate the physical frame number for the given vaddr using the page table.
  *
@@ -151,135 +486,274 @@ void init_frame(int frame, addr_t vaddr) {
  * Counters for hit, miss and reference events should be incremented in
  * this function.
  */
-char* find_physpage(addr_t vaddr, char type) {
+char* find_physpage(struct sim* s, addr_t vaddr, char type) {
     pgtbl_entry_t* table_entry_ptr = NULL; // pointer to the full page table entry for vaddr
+    pgdir_entry_t* pmd = NULL; // last directory entry on the way to it
 
-    // Get the index for the directory entry
-    unsigned dir_index = PGDIR_INDEX(vaddr);
-
-    // Initialize second level if directory entry is invalid
-    if (!(pgdir[dir_index].pde & PG_VALID)) {
-        pgdir[dir_index] = init_second_level();
+    // A TLB hit skips the walk. Evicted pages are shot down, so every
+    // translation still in the TLB is for a resident page, or for a region
+    // still mapped by a huge page.
+    if (s->tlb != NULL) {
+        table_entry_ptr = tlb_lookup(s->tlb, vaddr, &pmd);
     }
+    int tlb_miss = table_entry_ptr == NULL && pmd == NULL;
+    cost_begin(&s->cost, tlb_miss && s->tlb != NULL);
+
+    if (tlb_miss) {
+        if (vaddr >> s->layout->vaddr_bits) {
+            fprintf(stderr, "Address %#lx needs more than %u bits, "
+                    "try a deeper page table (-L)\n", vaddr, s->layout->vaddr_bits);
+            exit(1);
+        }
 
-    // Use top-level page directory to get pointer to 2nd-level page table
-    pgdir_entry_t dir_entry = pgdir[dir_index]; // Grabbing the directory entry
-    pgtbl_entry_t* table_start = (pgtbl_entry_t*) (dir_entry.pde & PAGE_MASK); // FRAME number of dir entry
+        // Walk the page table to the entry for vaddr. Regions that have never
+        // faulted point at the shared invalid tables.
+        table_entry_ptr = walk_pagetable(s, vaddr, 0, &pmd);
+        if ((pmd->pde & PDE_HUGE) && s->tlb != NULL) {
+            tlb_insert_huge(s->tlb, vaddr, pmd);
+        }
+    }
 
-    // Determine pointer to table entry
-    unsigned table_index = PGTBL_INDEX(vaddr); // Index for the entry in the page table
-    table_entry_ptr = &(table_start[table_index]); // Pointer to the page table entry
+    // Regions mapped by a huge page bypass their page table
+    if (pmd != NULL && (pmd->pde & PDE_HUGE)) {
+        log_event(s, EV_HIT, s->proc, vaddr, EV_NO_FRAME);
+        s->hit_count++;
+        s->proc->hit_count++;
+        s->ref_count++;
+        s->proc->ref_count++;
+        cost_end(&s->cost, 0);
+        return huge_ref(s->huge, pmd, vaddr, type);
+    }
 
     // Check if table_entry_ptr is valid or not, on swap or not, and handle appropriately
-    int is_valid = table_entry_ptr->frame & PG_VALID;
-    int is_swapped = table_entry_ptr->frame & PG_ONSWAP;
+    int is_valid = pte_test(table_entry_ptr, PG_VALID);
+    int is_swapped = pte_test(table_entry_ptr, PG_ONSWAP);
 
     // Entry is in memory, which means we've hit it
     if (is_valid) {
-        hit_count++;
+        s->hit_count++;
+        s->proc->hit_count++;
+        if (pte_test(table_entry_ptr, PG_PREFETCH)) {
+            entry_clear(s, table_entry_ptr, PG_PREFETCH);
+            s->prefetch_hit_count++;
+            // Prefetching only logs the page going into its frame if it
+            // came off swap, so this hit names the page
+            log_event(s, EV_HIT, s->proc, vaddr, pte_frame(table_entry_ptr));
+        } else {
+            log_hit(s, s->proc, vaddr, pte_frame(table_entry_ptr));
+        }
     }
 
     // Entry is not in memory, handle according to swap status
     else {
 
-        miss_count++;  // Not in memory -> counts as miss!
+        s->miss_count++;  // Not in memory -> counts as miss!
+        s->proc->miss_count++;
+        cost_fault(&s->cost, is_swapped);
 
-        // Allocate frame, retrieve frame and it's number
-        int frame_number = allocate_frame(table_entry_ptr);
-        unsigned frame = (unsigned) (frame_number << PAGE_SHIFT);
+        // First write to this region, so it needs tables of its own
+        if ((uintptr_t) table_entry_ptr - (uintptr_t) invalid_table[0] <
+            INVALID_TABLE_BYTES) {
+            table_entry_ptr = walk_pagetable(s, vaddr, 1, &pmd);
+        }
 
-        if (is_swapped) {
-            swap_pagein(frame_number, table_entry_ptr->swap_off); // Get page off swap
-            frame &= ~PG_ONSWAP; // Page is now off the swap -> ONSWAP = 0
-        } else {
-            init_frame(frame_number, vaddr); // need to make the actual frame
-            frame |= PG_DIRTY; // Page is in memory, still needs to be swapped -> DIRTY = 1
-            table_entry_ptr->swap_off = INVALID_SWAP; // Page still needs a swap offset
+        // First touch of this page counts towards promoting its region,
+        // and the touch that reaches the threshold is served by a huge page.
+        // The count stops there, so it fits below the table's address.
+        if (s->huge != NULL && !is_swapped) {
+            if (PDE_TOUCHES(pmd->pde) < huge_threshold(s->huge)) {
+                pmd->pde += 1 << PDE_TOUCH_SHIFT;
+            }
+            if (PDE_TOUCHES(pmd->pde) >= huge_threshold(s->huge)) {
+                log_event(s, EV_MISS, s->proc, vaddr, EV_NO_FRAME);
+                s->ref_count++;
+                s->proc->ref_count++;
+                char* mem = huge_fault(s, pmd, vaddr, type);
+                if (s->tlb != NULL) {
+                    tlb_insert_huge(s->tlb, vaddr, pmd);
+                }
+                cost_end(&s->cost, 1);
+                return mem;
+            }
+        }
+
+        if (s->prefetch != NULL) {
+            prefetch_pages(s, vaddr);
         }
 
-        // Put the frame into the entry
-        table_entry_ptr->frame = frame;
+        // Allocate frame, and fill it from swap or with zeros
+        fault_in(s, table_entry_ptr, vaddr, is_swapped);
+        log_event(s, EV_MISS, s->proc, vaddr, pte_frame(table_entry_ptr));
+    }
+
+    if (tlb_miss && s->tlb != NULL) {
+        tlb_insert(s->tlb, vaddr, table_entry_ptr);
     }
 
     // Make sure that frame of table_entry_ptr is marked valid and referenced
-    table_entry_ptr->frame |= PG_VALID; // VALID = 1
-    table_entry_ptr->frame |= PG_REF; // REF = 1
+    entry_set(s, table_entry_ptr, PG_VALID); // VALID = 1
+    entry_set(s, table_entry_ptr, PG_REF); // REF = 1
 
     // Mark frame of table_entry_ptr as dirty if the access type indicates that the page will be written to.
     if (type == 'M' || type == 'S') {
         // Store (S) or Modify (M) instructions imply the page is being written to
-        table_entry_ptr->frame |= PG_DIRTY; // DIRTY = 1
+        entry_set(s, table_entry_ptr, PG_DIRTY); // DIRTY = 1
     }
 
-    // Call replacement algorithm's ref_fcn for this page
-    ref_fcn(table_entry_ptr);
+    // Tell the replacement algorithm whether the page was resident, then
+    // call its ref_fcn for this page
+    if (is_valid && s->alg->on_hit != NULL) {
+        s->alg->on_hit(s, (int) pte_frame(table_entry_ptr), table_entry_ptr);
+    } else if (!is_valid && s->alg->on_miss != NULL) {
+        s->alg->on_miss(s, (int) pte_frame(table_entry_ptr), table_entry_ptr);
+    }
+    s->alg->ref(s, table_entry_ptr);
 
     // Increment ref count
-    ref_count++;
+    s->ref_count++;
+    s->proc->ref_count++;
+    cost_end(&s->cost, !is_valid);
 
     // Return pointer into (simulated) physical memory at start of frame
-    return &physmem[(table_entry_ptr->frame >> PAGE_SHIFT) * SIMPAGESIZE];
+    return &s->physmem[pte_frame(table_entry_ptr) * SIMPAGESIZE];
 }
 
-void print_pagetbl(pgtbl_entry_t* pgtbl) {
+/*
+ * The hit path of concurrent replay, run without the fault lock. Walks
+ * pgdir to vaddr's entry without installing tables, and if the page is
+ * resident, pins its frame against eviction, marks the page referenced
+ * (and dirty for a write) and returns the frame number. Returns -1 if the
+ * reference has to go through find_physpage() instead. Counters are left
+ * to the caller, which unpins the frame once it is done with its memory.
+ *
+ * A pin taken before the entry is checked again keeps the frame: evict_page()
+ * clears VALID before waiting for pins, so either it sees the pin or we see
+ * VALID clear and back off.
+ */
+int pin_physpage(struct sim* s, pgdir_entry_t* pgdir, addr_t vaddr,
+                 char type) {
+    const struct pgtbl_layout* l = s->layout;
+    pgdir_entry_t* dir = pgdir;
+    int d;
+
+    if (vaddr >> l->vaddr_bits) {
+        return -1;
+    }
+    for (d = 0; d < l->levels - 1; d++) {
+        pgdir_entry_t* entry = &dir[(vaddr >> l->shift[d]) &
+                                    (l->entries[d] - 1)];
+        dir = (pgdir_entry_t*) (__atomic_load_n(&entry->pde, __ATOMIC_ACQUIRE) &
+                                PAGE_MASK);
+    }
+    pgtbl_entry_t* p = &((pgtbl_entry_t*) dir)[(vaddr >> PAGE_SHIFT) &
+                                               (l->entries[d] - 1)];
+
+    pgtbl_entry_t e = pte_snapshot(p);
+    if (!pte_test(&e, PG_VALID)) {
+        return -1;
+    }
+    int frame = (int) pte_frame(&e);
+    __atomic_fetch_add(&s->coremap[frame].pins, 1, __ATOMIC_SEQ_CST);
+    e = pte_snapshot(p);
+    if (!pte_test(&e, PG_VALID) || (int) pte_frame(&e) != frame) {
+        unpin_frame(s, frame);
+        return -1;
+    }
+
+    // Only write the entry if a bit changes, so threads sharing a hot page
+    // don't keep taking its cache line from each other
+    unsigned flags = PG_REF | (type == 'M' || type == 'S' ? PG_DIRTY : 0);
+    if (pte_test(&e, flags) != flags) {
+        pte_set_atomic(p, flags);
+    }
+    return frame;
+}
+
+void unpin_frame(struct sim* s, int frame) {
+    __atomic_fetch_sub(&s->coremap[frame].pins, 1, __ATOMIC_SEQ_CST);
+}
+
+// Tabs to indent a table at each depth by
+static const char* indent = "\t\t\t\t";
+
+void print_pagetbl(pgtbl_entry_t* pgtbl, unsigned entries, int depth) {
     int i;
     int first_invalid, last_invalid;
     first_invalid = last_invalid = -1;
 
-    for (i = 0; i < PTRS_PER_PGTBL; i++) {
-        if (!(pgtbl[i].frame & PG_VALID) &&
-            !(pgtbl[i].frame & PG_ONSWAP)) {
+    for (i = 0; i < (int) entries; i++) {
+        if (!pte_test(&pgtbl[i], PG_VALID | PG_ONSWAP)) {
             if (first_invalid == -1) {
                 first_invalid = i;
             }
             last_invalid = i;
         } else {
             if (first_invalid != -1) {
-                printf("\t[%d] - [%d]: INVALID\n",
+                printf("%.*s[%d] - [%d]: INVALID\n", depth, indent,
                        first_invalid, last_invalid);
                 first_invalid = last_invalid = -1;
             }
-            printf("\t[%d]: ", i);
-            if (pgtbl[i].frame & PG_VALID) {
+            printf("%.*s[%d]: ", depth, indent, i);
+            if (pte_test(&pgtbl[i], PG_VALID)) {
                 printf("VALID, ");
-                if (pgtbl[i].frame & PG_DIRTY) {
+                if (pte_test(&pgtbl[i], PG_DIRTY)) {
                     printf("DIRTY, ");
                 }
-                printf("in frame %d\n", pgtbl[i].frame >> PAGE_SHIFT);
+                printf("in frame %d\n", pte_frame(&pgtbl[i]));
             } else {
-                assert(pgtbl[i].frame & PG_ONSWAP);
-                printf("ONSWAP, at offset %lu\n", pgtbl[i].swap_off);
+                assert(pte_test(&pgtbl[i], PG_ONSWAP));
+                printf("ONSWAP, at offset %d\n", pte_swap_off(&pgtbl[i]));
             }
         }
     }
     if (first_invalid != -1) {
-        printf("\t[%d] - [%d]: INVALID\n", first_invalid, last_invalid);
+        printf("%.*s[%d] - [%d]: INVALID\n", depth, indent,
+               first_invalid, last_invalid);
         first_invalid = last_invalid = -1;
     }
 }
 
-void print_pagedirectory() {
-    int i; // index into pgdir
+void print_dir(const struct pgtbl_layout* l, pgdir_entry_t* dir, int depth) {
+    int i; // index into dir
     int first_invalid, last_invalid;
     first_invalid = last_invalid = -1;
 
-    pgtbl_entry_t* pgtbl;
+    void* table;
 
-    for (i = 0; i < PTRS_PER_PGDIR; i++) {
-        if (!(pgdir[i].pde & PG_VALID)) {
+    for (i = 0; i < (int) l->entries[depth]; i++) {
+        if (!(dir[i].pde & PG_VALID)) {
             if (first_invalid == -1) {
                 first_invalid = i;
             }
             last_invalid = i;
         } else {
             if (first_invalid != -1) {
-                printf("[%d]: INVALID\n  to\n[%d]: INVALID\n",
-                       first_invalid, last_invalid);
+                printf("%.*s[%d]: INVALID\n%.*s  to\n%.*s[%d]: INVALID\n",
+                       depth, indent, first_invalid, depth, indent,
+                       depth, indent, last_invalid);
                 first_invalid = last_invalid = -1;
             }
-            pgtbl = (pgtbl_entry_t*) (pgdir[i].pde & PAGE_MASK);
-            printf("[%d]: %p\n", i, pgtbl);
-            print_pagetbl(pgtbl);
+            table = (void*) (dir[i].pde & PAGE_MASK);
+            printf("%.*s[%d]: %p%s\n", depth, indent, i, table,
+                   dir[i].pde & PDE_HUGE ? " HUGE" : "");
+            if (depth + 1 == l->levels - 1) {
+                print_pagetbl(table, l->entries[depth + 1], depth + 1);
+            } else {
+                print_dir(l, table, depth + 1);
+            }
         }
     }
 }
+
+void print_pagedirectory(struct sim* s) {
+    int i;
+
+    if (s->nprocs == 1) {
+        print_dir(s->layout, s->pgdir, 0);
+        return;
+    }
+    for (i = 0; i < s->nprocs; i++) {
+        printf("Process %u:\n", s->procs[i]->pid);
+        print_dir(s->layout, s->procs[i]->pgdir, 0);
+    }
+}
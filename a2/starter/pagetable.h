@@ -10,10 +10,12 @@
 #define PAGE_SHIFT      12     // number of bits 2^(PAGE_SHIFT) == PAGE_SIZE
 #define PAGE_SIZE       4096 // Size of pagetable pages
 #define PAGE_MASK       (~(PAGE_SIZE-1))
+#define SIMPAGESIZE     16 // Simulated physical memory page frame size
 #define PG_VALID        (0x1) // Valid bit in pgd or pte, set if in memory
 #define PG_DIRTY        (0x2) // Dirty bit in pgd or pte, set if modified
 #define PG_REF          (0x4) // Reference bit, set if page has been referenced
 #define PG_ONSWAP       (0x8) // Set if page has been evicted to swap
+#define PG_PREFETCH     (0x10) // Set if page was prefetched and not yet referenced
 #define INVALID_SWAP    -1
 
 #ifdef TRACE_64
@@ -24,6 +26,7 @@
 #define PGDIR_SHIFT         24     // Leaves just top 12 bits of vaddr 
 #define PTRS_PER_PGDIR    4096
 #define PTRS_PER_PGTBL    4096
+#define VADDR_BITS          36
 
 #else // TRACE_32
 // User-level virtual addresses on 32-bit Linux system are 32 bits, and the
@@ -33,6 +36,7 @@
 #define PGDIR_SHIFT       22     // Leaves just top 10 bits of vaddr 
 #define PTRS_PER_PGDIR  1024
 #define PTRS_PER_PGTBL  1024
+#define VADDR_BITS        32
 
 #endif
 
@@ -40,9 +44,41 @@
 #define PGDIR_INDEX(x)   ((x) >> PGDIR_SHIFT)
 #define PGTBL_INDEX(x)   (((x) >> PAGE_SHIFT) & PGTBL_MASK)
 
+// The split above is the default 2-level layout. 'sim -L 3' or 'sim -L 4'
+// instead walks a radix tree with 9 bits per level like x86-64, which covers
+// 39 or 48 bit addresses (e.g. stacks near 0x7ffc...) with 512 entry tables.
+#define MAX_PGTBL_LEVELS      4
+#define MAX_PTRS_PER_TABLE 4096
+
+struct pgtbl_layout {
+    int levels;                         // Number of levels, counting the pgdir
+    unsigned vaddr_bits;                // Bits of vaddr the layout can map
+    unsigned shift[MAX_PGTBL_LEVELS];   // Index shift per level, top first
+    unsigned entries[MAX_PGTBL_LEVELS]; // Table size per level, top first
+};
+
+extern int pgtbl_levels;
+
+// With 9 bit levels a last-level table covers 2MB, which a huge page (-H)
+// maps directly from the directory entry above it. The free low bits of
+// that entry count how many of the region's pages have been touched.
+#define HUGE_SHIFT         21
+#define HUGE_PAGES         (1 << (HUGE_SHIFT - PAGE_SHIFT))
+#define PDE_HUGE           (0x2) // Set if the entry maps a huge page
+#define PDE_TOUCH_SHIFT    2
+#define PDE_TOUCHES(pde)   (((pde) & ~PAGE_MASK) >> PDE_TOUCH_SHIFT)
+
+extern const struct pgtbl_layout* find_pgtbl_layout(int levels);
+
 
 typedef unsigned long addr_t;
 
+// Entries are read and replaced with relaxed atomics, which cost nothing
+// over plain loads and stores, so threads replaying one instance (sim -c)
+// may look at entries another thread is changing. pte_set_atomic() and
+// pte_clear_atomic() are for the status bits of resident pages, which those
+// threads mark referenced or dirty without taking the fault lock.
+
 // These defines allow us to take advantage of the compiler's typechecking
 
 // Page directory entry (top-level)
@@ -50,74 +86,248 @@ typedef struct {
     uintptr_t pde;
 } pgdir_entry_t;
 
-// Page table entry (2nd-level). 
+#ifdef PACKED_PTE
+// Page table entry (2nd-level), packed into 8 bytes (build with
+// 'make PACKED_PTE=1'). The low PTE_FLAG_BITS bits hold the status bits,
+// the next PTE_FRAME_BITS the frame number, and the rest the swap slot of
+// vpage (its swap offset / SIMPAGESIZE), all ones for INVALID_SWAP.
 typedef struct {
-    unsigned int frame; // if valid bit == 1, physical frame holding vpage
+    uint64_t pte;
+} pgtbl_entry_t;
+
+#define PTE_FLAG_BITS   8
+#define PTE_FRAME_BITS  28
+#define PTE_SLOT_SHIFT  (PTE_FLAG_BITS + PTE_FRAME_BITS)
+#define PTE_FRAME_MASK  ((((uint64_t) 1 << PTE_FRAME_BITS) - 1) << PTE_FLAG_BITS)
+#define PTE_SLOT_MASK   (~(uint64_t) 0 << PTE_SLOT_SHIFT)
+#define PTE_NO_SLOT     (~(uint64_t) 0 >> PTE_SLOT_SHIFT)
+
+// Physical frame number holding vpage, if valid bit == 1
+static inline unsigned pte_frame(const pgtbl_entry_t* p) {
+    return (unsigned) ((__atomic_load_n(&p->pte, __ATOMIC_RELAXED) & PTE_FRAME_MASK) >>
+                       PTE_FLAG_BITS);
+}
+
+// Nonzero if any of the PG_* bits in flags are set
+static inline unsigned pte_test(const pgtbl_entry_t* p, unsigned flags) {
+    return (unsigned) __atomic_load_n(&p->pte, __ATOMIC_RELAXED) & flags;
+}
+
+static inline void pte_set(pgtbl_entry_t* p, unsigned flags) {
+    p->pte |= flags;
+}
+
+static inline void pte_clear(pgtbl_entry_t* p, unsigned flags) {
+    p->pte &= ~(uint64_t) flags;
+}
+
+static inline void pte_set_atomic(pgtbl_entry_t* p, unsigned flags) {
+    __atomic_fetch_or(&p->pte, (uint64_t) flags, __ATOMIC_SEQ_CST);
+}
+
+static inline void pte_clear_atomic(pgtbl_entry_t* p, unsigned flags) {
+    __atomic_fetch_and(&p->pte, ~(uint64_t) flags, __ATOMIC_SEQ_CST);
+}
+
+// A copy of the frame and status bits, read atomically
+static inline pgtbl_entry_t pte_snapshot(const pgtbl_entry_t* p) {
+    pgtbl_entry_t e;
+    e.pte = __atomic_load_n(&p->pte, __ATOMIC_SEQ_CST);
+    return e;
+}
+
+// Points the entry at frame, clearing all status bits
+static inline void pte_set_frame(pgtbl_entry_t* p, unsigned frame) {
+    __atomic_store_n(&p->pte, (p->pte & PTE_SLOT_MASK) |
+                     ((uint64_t) frame << PTE_FLAG_BITS), __ATOMIC_RELAXED);
+}
+
+static inline int pte_swap_off(const pgtbl_entry_t* p) {
+    uint64_t slot = p->pte >> PTE_SLOT_SHIFT;
+    return slot == PTE_NO_SLOT ? INVALID_SWAP : (int) slot * SIMPAGESIZE;
+}
+
+static inline void pte_set_swap_off(pgtbl_entry_t* p, int swap_off) {
+    uint64_t slot = swap_off == INVALID_SWAP ? PTE_NO_SLOT :
+                    (uint64_t) (swap_off / SIMPAGESIZE);
+    __atomic_store_n(&p->pte, (p->pte & ~PTE_SLOT_MASK) |
+                     (slot << PTE_SLOT_SHIFT), __ATOMIC_RELAXED);
+}
+
+#else
+// Page table entry (2nd-level). The status bits sit below PAGE_SHIFT and
+// the frame number above it, in 64 bits so no frame number is cut off.
+typedef struct {
+    uint64_t frame;     // if valid bit == 1, physical frame holding vpage
     off_t swap_off;       // offset in swap file of vpage, if any
 } pgtbl_entry_t;
 
-extern void init_pagetable();
+static inline unsigned pte_frame(const pgtbl_entry_t* p) {
+    return (unsigned) (__atomic_load_n(&p->frame, __ATOMIC_RELAXED) >> PAGE_SHIFT);
+}
+
+static inline unsigned pte_test(const pgtbl_entry_t* p, unsigned flags) {
+    return (unsigned) __atomic_load_n(&p->frame, __ATOMIC_RELAXED) & flags;
+}
+
+static inline void pte_set(pgtbl_entry_t* p, unsigned flags) {
+    p->frame |= flags;
+}
+
+static inline void pte_clear(pgtbl_entry_t* p, unsigned flags) {
+    p->frame &= ~(uint64_t) flags;
+}
+
+static inline void pte_set_atomic(pgtbl_entry_t* p, unsigned flags) {
+    __atomic_fetch_or(&p->frame, (uint64_t) flags, __ATOMIC_SEQ_CST);
+}
+
+static inline void pte_clear_atomic(pgtbl_entry_t* p, unsigned flags) {
+    __atomic_fetch_and(&p->frame, ~(uint64_t) flags, __ATOMIC_SEQ_CST);
+}
+
+// A copy of the frame and status bits, read atomically
+static inline pgtbl_entry_t pte_snapshot(const pgtbl_entry_t* p) {
+    pgtbl_entry_t e;
+    e.frame = __atomic_load_n(&p->frame, __ATOMIC_SEQ_CST);
+    e.swap_off = 0;
+    return e;
+}
+
+static inline void pte_set_frame(pgtbl_entry_t* p, unsigned frame) {
+    __atomic_store_n(&p->frame, (uint64_t) frame << PAGE_SHIFT, __ATOMIC_RELAXED);
+}
+
+static inline int pte_swap_off(const pgtbl_entry_t* p) {
+    return (int) p->swap_off;
+}
+
+static inline void pte_set_swap_off(pgtbl_entry_t* p, int swap_off) {
+    p->swap_off = swap_off;
+}
+
+#endif
+
+// All simulator state lives in a struct sim (see sim.h)
+struct sim;
+struct proc;
+
+extern void init_pagetable(struct sim* s);
+
+extern void destroy_pagetable(struct sim* s);
+
+// Makes pid's address space the current one, creating it on first use
+extern void switch_process(struct sim* s, unsigned pid);
+
+// Evicts frame's page and frees the frame
+extern void release_frame(struct sim* s, int frame);
+
+extern char* find_physpage(struct sim* s, addr_t vaddr, char type);
 
-extern char* find_physpage(addr_t vaddr, char type);
+// Concurrent replay's hit path, which doesn't fault (see pagetable.c)
+extern int pin_physpage(struct sim* s, pgdir_entry_t* pgdir, addr_t vaddr,
+                        char type);
 
-extern void print_pagedirectory(void);
+extern void unpin_frame(struct sim* s, int frame);
+
+extern void print_pagedirectory(struct sim* s);
 
 struct frame {
     char in_use;       // True if frame is allocated, False if frame is free
     pgtbl_entry_t* pte;// Pointer back to pagetable entry (pte) for page
                        // stored in this frame
+    addr_t vaddr;      // Virtual address of that page
+    struct proc* proc; // Process whose page it is
+    int pins;          // Threads reading the page without the fault lock
+};
 
-    //region NEW ADDITIONS
-    unsigned page; // Used in opt to match frames to pages
 
-    //endregion
-};
+// Swap functions for use in other files
+struct swap;
 
-/* The coremap holds information about physical memory.
- * The index into coremap is the physical page frame number stored
- * in the page table entry (pgtbl_entry_t).
- */
-extern struct frame* coremap;
+// Swap backends ("file", "mem", "mmap" or "async") are looked up by name
+struct swap_backend;
 
+extern struct swap_backend* swap_find_backend(char* name);
 
-// Swap functions for use in other files
-extern int swap_init(unsigned swapsize);
+extern struct swap* swap_init(unsigned swapsize, struct swap_backend* backend);
+
+extern void swap_destroy(struct swap* swap);
+
+extern int swap_pagein(struct sim* s, unsigned frame, int swap_offset);
+
+extern int swap_pageout(struct sim* s, unsigned frame, int swap_offset);
+
+// Like swap_pagein() and swap_pageout(), for page data outside physmem
+extern int swap_read(struct sim* s, char* page, int swap_offset);
+
+extern int swap_write(struct sim* s, char* page, int swap_offset);
+
+extern void rand_init(struct sim* s);
+
+extern void lru_init(struct sim* s);
+
+extern void clock_init(struct sim* s);
 
-extern void swap_destroy(void);
+extern void fifo_init(struct sim* s);
 
-extern int swap_pagein(unsigned frame, int swap_offset);
+extern void opt_init(struct sim* s);
 
-extern int swap_pageout(unsigned frame, int swap_offset);
+extern void arc_init(struct sim* s);
 
-extern void rand_init();
+extern void clockpro_init(struct sim* s);
 
-extern void lru_init();
+extern void twoq_init(struct sim* s);
 
-extern void clock_init();
+extern void aging_init(struct sim* s);
 
-extern void fifo_init();
+extern void ws_init(struct sim* s);
 
-extern void opt_init();
+extern void pff_init(struct sim* s);
 
 // These may not need to do anything for some algorithms
-extern void rand_ref(pgtbl_entry_t*);
+extern void rand_ref(struct sim* s, pgtbl_entry_t*);
+
+extern void lru_ref(struct sim* s, pgtbl_entry_t*);
+
+extern void clock_ref(struct sim* s, pgtbl_entry_t*);
+
+extern void fifo_ref(struct sim* s, pgtbl_entry_t*);
+
+extern void opt_ref(struct sim* s, pgtbl_entry_t*);
+
+extern void arc_ref(struct sim* s, pgtbl_entry_t*);
+
+extern void clockpro_ref(struct sim* s, pgtbl_entry_t*);
+
+extern void twoq_ref(struct sim* s, pgtbl_entry_t*);
+
+extern void aging_ref(struct sim* s, pgtbl_entry_t*);
+
+extern void ws_ref(struct sim* s, pgtbl_entry_t*);
+
+extern void pff_ref(struct sim* s, pgtbl_entry_t*);
+
+extern int rand_evict(struct sim* s);
+
+extern int lru_evict(struct sim* s);
 
-extern void lru_ref(pgtbl_entry_t*);
+extern int clock_evict(struct sim* s);
 
-extern void clock_ref(pgtbl_entry_t*);
+extern int fifo_evict(struct sim* s);
 
-extern void fifo_ref(pgtbl_entry_t*);
+extern int opt_evict(struct sim* s);
 
-extern void opt_ref(pgtbl_entry_t*);
+extern int arc_evict(struct sim* s);
 
-extern int rand_evict();
+extern int clockpro_evict(struct sim* s);
 
-extern int lru_evict();
+extern int twoq_evict(struct sim* s);
 
-extern int clock_evict();
+extern int aging_evict(struct sim* s);
 
-extern int fifo_evict();
+extern int ws_evict(struct sim* s);
 
-extern int opt_evict();
+extern int pff_evict(struct sim* s);
 
 #endif /* PAGETABLE_H */
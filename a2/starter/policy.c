@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <dlfcn.h>
+#include "sim.h"
+#include "pagetable.h"
+#include "policy.h"
+
+//region DESCRIPTION OF POLICY PLUGINS
+
+/*
+ * A plugin is run through an ordinary struct functions whose entries
+ * forward to the plugin's struct policy (kept in alg->plugin). The
+ * context the plugin creates for an instance is that instance's
+ * s->alg_data, so nothing here is global and each instance is independent.
+ *
+ * Plugins are never unloaded: their functions stay in use until every
+ * instance running them is destroyed, which is at the end of the run.
+ * */
+
+//endregion
+
+static void plugin_init(struct sim* s) {
+    s->alg_data = s->alg->plugin->create(s->memsize);
+}
+
+static void plugin_destroy(struct sim* s) {
+    if (s->alg->plugin->destroy != NULL) {
+        s->alg->plugin->destroy(s->alg_data);
+    }
+}
+
+// Every reference reaches the plugin through on_hit or on_miss instead
+static void plugin_ref(struct sim* s, pgtbl_entry_t* p) {
+    return;
+}
+
+static int plugin_evict(struct sim* s) {
+    int frame = s->alg->plugin->evict(s->alg_data);
+    if (frame < 0 || frame >= (int) s->memsize ||
+        !s->coremap[frame].in_use) {
+        fprintf(stderr, "Error: %s evicted frame %d, which is not in use\n",
+                s->alg->name, frame);
+        exit(1);
+    }
+    return frame;
+}
+
+static void plugin_alloc(struct sim* s, int frame, pgtbl_entry_t* p) {
+    s->alg->plugin->on_alloc(s->alg_data, frame, p);
+}
+
+static void plugin_evicted(struct sim* s, int frame, pgtbl_entry_t* p) {
+    s->alg->plugin->on_evict(s->alg_data, frame, p);
+}
+
+static void plugin_hit(struct sim* s, int frame, pgtbl_entry_t* p) {
+    s->alg->plugin->on_hit(s->alg_data, frame, p);
+}
+
+static void plugin_miss(struct sim* s, int frame, pgtbl_entry_t* p) {
+    s->alg->plugin->on_miss(s->alg_data, frame, p);
+}
+
+struct functions* policy_load(const char* path) {
+    void* handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+        fprintf(stderr, "Error: %s\n", dlerror());
+        return NULL;
+    }
+
+    const struct policy* p = dlsym(handle, POLICY_SYMBOL);
+    if (p == NULL) {
+        fprintf(stderr, "Error: %s does not define %s\n", path, POLICY_SYMBOL);
+        return NULL;
+    }
+    if (p->version != POLICY_API_VERSION) {
+        fprintf(stderr, "Error: %s was built for policy API version %u, not %u\n",
+                path, p->version, POLICY_API_VERSION);
+        return NULL;
+    }
+    if (p->pte_size != sizeof(pgtbl_entry_t)) {
+        fprintf(stderr, "Error: %s was built for %u byte page table entries, "
+                "not %u (PACKED_PTE)\n", path, p->pte_size,
+                (unsigned) sizeof(pgtbl_entry_t));
+        return NULL;
+    }
+    if (p->create == NULL || p->evict == NULL) {
+        fprintf(stderr, "Error: %s has no create or evict function\n", path);
+        return NULL;
+    }
+
+    // Only forward the hooks the plugin has, so the rest cost nothing
+    struct functions* alg = calloc(1, sizeof(struct functions));
+    alg->name = (char*) (p->name != NULL ? p->name : path);
+    alg->init = plugin_init;
+    alg->ref = plugin_ref;
+    alg->evict = plugin_evict;
+    alg->destroy = plugin_destroy;
+    alg->on_alloc = p->on_alloc != NULL ? plugin_alloc : NULL;
+    alg->on_evict = p->on_evict != NULL ? plugin_evicted : NULL;
+    alg->on_hit = p->on_hit != NULL ? plugin_hit : NULL;
+    alg->on_miss = p->on_miss != NULL ? plugin_miss : NULL;
+    alg->plugin = p;
+    return alg;
+}
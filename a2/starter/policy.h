@@ -0,0 +1,56 @@
+#ifndef __POLICY_H__
+#define __POLICY_H__
+
+#include "pagetable.h"
+
+/* Replacement policies loaded from shared objects (sim -a ./libfoo.so).
+ *
+ * A plugin defines one struct policy named sim_policy, e.g.
+ *
+ *      const struct policy sim_policy = {
+ *          POLICY_API_VERSION, sizeof(pgtbl_entry_t), "foo",
+ *          foo_create, foo_destroy, foo_evict, foo_alloc, NULL, NULL, NULL
+ *      };
+ *
+ * and is built with -fPIC -shared (see policy_fifo.c and the Makefile).
+ * sim refuses a plugin whose version or pte_size differs from its own, so
+ * one built against another version of this header, or with the other PTE
+ * layout (PACKED_PTE), is not misread.
+ *
+ * Each simulator instance gets its own context from create(), and every
+ * other callback is passed it, so plugins need no globals and several
+ * instances can run at once. Pages are named by their page table entry,
+ * which keeps its address for the life of the instance and can be read
+ * with the pte_* accessors, e.g. pte_test(p, PG_REF). Only create and evict
+ * are required; any other callback may be NULL.
+ */
+#define POLICY_API_VERSION 1
+#define POLICY_SYMBOL "sim_policy"
+
+struct policy {
+	unsigned version;           // POLICY_API_VERSION the plugin was built with
+	unsigned pte_size;          // sizeof(pgtbl_entry_t) the plugin was built with
+	const char *name;
+
+	void *(*create)(unsigned memsize);  // Returns the instance's context
+	void (*destroy)(void *ctx);
+	int (*evict)(void *ctx);            // Returns the frame to evict
+
+	// p has just been given frame, and will be referenced next
+	void (*on_alloc)(void *ctx, int frame, pgtbl_entry_t *p);
+	// p has just been evicted from frame
+	void (*on_evict)(void *ctx, int frame, pgtbl_entry_t *p);
+	// p, in frame, was referenced and was (on_hit) or was not (on_miss)
+	// already in memory
+	void (*on_hit)(void *ctx, int frame, pgtbl_entry_t *p);
+	void (*on_miss)(void *ctx, int frame, pgtbl_entry_t *p);
+};
+
+struct functions;
+
+/* Loads the plugin at path and returns an eviction algorithm that runs it,
+ * or NULL (after saying why on stderr) if it can't be used.
+ */
+extern struct functions *policy_load(const char *path);
+
+#endif // __POLICY_H__
@@ -0,0 +1,56 @@
+/* File:     Example policy plugin
+ *
+ * Purpose:  FIFO written against the plugin API in policy.h, as a starting
+ *           point for new policies. It should evict exactly what the
+ *           built-in fifo does.
+ *
+ * Compile:  make libpolicy_fifo.so
+ * Run:      ./sim -f tracefile -m 50 -s 1000 -a ./libpolicy_fifo.so
+ *
+ * Notes:
+ * 1.  Frames are queued when they are allocated, so a hit costs nothing,
+ *     and the oldest is evicted.
+ */
+#include <stdlib.h>
+#include "policy.h"
+
+typedef struct {
+    unsigned size;
+    unsigned front;     // Index of the oldest frame
+    unsigned count;
+    int* frames;        // Circular queue of frame numbers
+} Fifo;
+
+static void* queue_create(unsigned memsize) {
+    Fifo* f = malloc(sizeof(Fifo));
+    f->size = memsize;
+    f->front = 0;
+    f->count = 0;
+    f->frames = malloc(memsize * sizeof(int));
+    return f;
+}
+
+static void queue_destroy(void* ctx) {
+    Fifo* f = ctx;
+    free(f->frames);
+    free(f);
+}
+
+static int queue_evict(void* ctx) {
+    Fifo* f = ctx;
+    int frame = f->frames[f->front];
+    f->front = (f->front + 1) % f->size;
+    f->count--;
+    return frame;
+}
+
+static void queue_alloc(void* ctx, int frame, pgtbl_entry_t* p) {
+    Fifo* f = ctx;
+    f->frames[(f->front + f->count) % f->size] = frame;
+    f->count++;
+}
+
+const struct policy sim_policy = {
+        POLICY_API_VERSION, sizeof(pgtbl_entry_t), "fifo-so",
+        queue_create, queue_destroy, queue_evict, queue_alloc, NULL, NULL, NULL
+};
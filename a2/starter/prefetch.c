@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "prefetch.h"
+#include "trace.h"
+
+//region DESCRIPTION OF PREFETCHERS
+
+/*
+ * Prefetchers only see the stream of misses, one (pid, vaddr) at a time,
+ * and return page-aligned vaddrs in the same process. find_physpage() drops
+ * predictions that are already resident or outside the address space, so
+ * they don't need to check.
+ *
+ * The trace has no instruction addresses, so stride detection can't be
+ * per load instruction as in a hardware stride prefetcher. It follows the
+ * miss stream of the process instead: a stride is confirmed when two
+ * consecutive misses are the same nonzero number of pages apart, and a
+ * miss from another process starts over.
+ *
+ * The Markov table is direct-mapped on the missing page (with its pid) and
+ * holds the last 'degree' distinct pages that missed right after it.
+ * A collision simply replaces the entry.
+ * */
+
+//endregion
+
+const struct prefetcher* prefetcher = NULL;
+unsigned prefetch_degree = 4;
+
+struct prefetch {
+    const struct prefetcher* p;
+    void* state;
+};
+
+typedef struct {
+    unsigned degree;
+} Next;
+
+static void* next_create(unsigned degree) {
+    Next* n = malloc(sizeof(Next));
+    n->degree = degree;
+    return n;
+}
+
+static int next_predict(void* state, unsigned pid, addr_t vaddr,
+                        addr_t* pages) {
+    Next* n = state;
+    unsigned i;
+
+    for (i = 0; i < n->degree; i++) {
+        pages[i] = (vaddr & PAGE_MASK) + (addr_t) (i + 1) * PAGE_SIZE;
+    }
+    return (int) n->degree;
+}
+
+typedef struct {
+    unsigned degree;
+    unsigned pid;           // Process of the last miss
+    addr_t page;            // Page number of the last miss
+    long stride;            // Pages between the last two misses
+    int valid;              // Whether page and stride are set
+} Stride;
+
+static void* stride_create(unsigned degree) {
+    Stride* st = calloc(1, sizeof(Stride));
+    st->degree = degree;
+    return st;
+}
+
+static int stride_predict(void* state, unsigned pid, addr_t vaddr,
+                          addr_t* pages) {
+    Stride* st = state;
+    addr_t page = vaddr >> PAGE_SHIFT;
+    int n = 0;
+    unsigned i;
+
+    if (st->valid && st->pid == pid) {
+        long stride = (long) (page - st->page);
+        if (stride != 0 && stride == st->stride) {
+            for (i = 0; i < st->degree; i++) {
+                pages[n++] = (page + (i + 1) * stride) << PAGE_SHIFT;
+            }
+        }
+        st->stride = stride;
+    } else {
+        st->stride = 0;
+    }
+    st->pid = pid;
+    st->page = page;
+    st->valid = 1;
+    return n;
+}
+
+#define MARKOV_BITS    14
+#define MARKOV_ENTRIES (1 << MARKOV_BITS)
+
+typedef struct {
+    addr_t key;                              // trace_page() of the miss
+    int count;                               // Successors recorded
+    addr_t next[PREFETCH_MAX_DEGREE];        // Their trace_page(), newest first
+} MarkovEntry;
+
+typedef struct {
+    unsigned degree;
+    addr_t last;                             // trace_page() of the last miss
+    int have_last;
+    MarkovEntry* table;
+} Markov;
+
+static MarkovEntry* markov_entry(Markov* m, addr_t key) {
+    return &m->table[(key * 0x9e3779b97f4a7c15UL) >> (64 - MARKOV_BITS)];
+}
+
+static void* markov_create(unsigned degree) {
+    Markov* m = calloc(1, sizeof(Markov));
+    m->degree = degree;
+    m->table = calloc(MARKOV_ENTRIES, sizeof(MarkovEntry));
+    return m;
+}
+
+static void markov_destroy(void* state) {
+    Markov* m = state;
+    free(m->table);
+    free(m);
+}
+
+static int markov_predict(void* state, unsigned pid, addr_t vaddr,
+                          addr_t* pages) {
+    Markov* m = state;
+    addr_t key = trace_page(pid, vaddr);
+    MarkovEntry* e;
+    int i, n = 0;
+
+    // Record this miss as the newest successor of the last one
+    if (m->have_last) {
+        e = markov_entry(m, m->last);
+        if (e->key != m->last) {
+            e->key = m->last;
+            e->count = 0;
+        }
+        // Move key to the front, dropping the oldest successor if it's new
+        // and the entry is full
+        for (i = 0; i < e->count && e->next[i] != key; i++) {
+        }
+        if (i == e->count) {
+            if (e->count < (int) m->degree) {
+                e->count++;
+            } else {
+                i--;
+            }
+        }
+        memmove(&e->next[1], &e->next[0], i * sizeof(addr_t));
+        e->next[0] = key;
+    }
+    m->last = key;
+    m->have_last = 1;
+
+    // Predict what followed this page before. Successors in another
+    // process can't be faulted in from here.
+    e = markov_entry(m, key);
+    if (e->key == key) {
+        for (i = 0; i < e->count; i++) {
+            if (e->next[i] >> TRACE_PID_SHIFT == pid) {
+                pages[n++] = (e->next[i] & (((addr_t) 1 << TRACE_PID_SHIFT) - 1))
+                        << PAGE_SHIFT;
+            }
+        }
+    }
+    return n;
+}
+
+static const struct prefetcher prefetchers[] = {
+        {"next", next_create, free, next_predict},
+        {"stride", stride_create, free, stride_predict},
+        {"markov", markov_create, markov_destroy, markov_predict},
+};
+
+const struct prefetcher* prefetch_find(const char* name) {
+    size_t i;
+    for (i = 0; i < sizeof(prefetchers) / sizeof(prefetchers[0]); i++) {
+        if (strcmp(prefetchers[i].name, name) == 0) {
+            return &prefetchers[i];
+        }
+    }
+    return NULL;
+}
+
+struct prefetch* prefetch_create(const struct prefetcher* p, unsigned degree) {
+    struct prefetch* pf = malloc(sizeof(struct prefetch));
+    pf->p = p;
+    pf->state = p->create(degree);
+    return pf;
+}
+
+void prefetch_destroy(struct prefetch* pf) {
+    pf->p->destroy(pf->state);
+    free(pf);
+}
+
+int prefetch_predict(struct prefetch* pf, unsigned pid, addr_t vaddr,
+                     addr_t* pages) {
+    return pf->p->predict(pf->state, pid, vaddr, pages);
+}
@@ -0,0 +1,49 @@
+#ifndef __PREFETCH_H__
+#define __PREFETCH_H__
+
+#include "pagetable.h"
+
+/* Read-ahead on page faults (-P kind[:degree]).
+ *
+ * When a reference misses, the instance's prefetcher predicts up to
+ * 'degree' other pages of the same process that are about to be used, and
+ * those that aren't resident are faulted in along with it. Prefetched pages
+ * are marked PG_PREFETCH until their first reference, which counts as a
+ * useful prefetch; if they are evicted first the prefetch was wasted.
+ *
+ *      next   - the pages following the one that missed
+ *      stride - once the same distance separates two consecutive misses,
+ *               the pages continuing that stride
+ *      markov - the pages that missed right after earlier misses on this
+ *               page, most recent first (a correlation table)
+ */
+#define PREFETCH_MAX_DEGREE 16
+
+struct prefetch;
+
+// A prefetcher's state is created per instance, so instances don't interact
+struct prefetcher {
+    const char* name;
+    void* (*create)(unsigned degree);
+    void (*destroy)(void* state);
+    // Stores up to degree page-aligned vaddrs to prefetch after pid missed
+    // on vaddr, and returns how many
+    int (*predict)(void* state, unsigned pid, addr_t vaddr, addr_t* pages);
+};
+
+// The prefetcher in use, or NULL, and how many pages it may predict
+extern const struct prefetcher* prefetcher;
+extern unsigned prefetch_degree;
+
+// The prefetcher called name, or NULL
+extern const struct prefetcher* prefetch_find(const char* name);
+
+extern struct prefetch* prefetch_create(const struct prefetcher* p,
+                                        unsigned degree);
+
+extern void prefetch_destroy(struct prefetch* pf);
+
+extern int prefetch_predict(struct prefetch* pf, unsigned pid, addr_t vaddr,
+                            addr_t* pages);
+
+#endif // __PREFETCH_H__
@@ -6,17 +6,25 @@
 #include "sim.h"
 #include "pagetable.h"
 
-
-
-extern struct frame *coremap;
+// Each instance has its own generator so instances don't perturb each other.
+// It is seeded like random()'s default state, so a single run evicts the
+// same frames as plain random() would.
+struct rand_data {
+	struct random_data buf;
+	char state[128];
+};
 
 /* Page to evict is chosen using the rand algorithm.
  * Returns the page frame number (which is also the index in the coremap)
  * for the page that is to be evicted.
  */
-int rand_evict() {
+int rand_evict(struct sim *s) {
+	struct rand_data *rd = s->alg_data;
+	int32_t r;
+
 	// choose index in coremap to evict a page from
-	int idx = (int)(random() % memsize);
+	random_r(&rd->buf, &r);
+	int idx = (int)(r % s->memsize);
 	
 	return idx;
 }
@@ -25,10 +33,13 @@ int rand_evict() {
  * needed by the rand algorithm.
  * Input: The page table entry for the page that is being accessed.
  */
-void rand_ref(pgtbl_entry_t *p) {
+void rand_ref(struct sim *s, pgtbl_entry_t *p) {
 
 	return;
 }
 
-void rand_init() {
+void rand_init(struct sim *s) {
+	struct rand_data *rd = calloc(1, sizeof(struct rand_data));
+	initstate_r(1, rd->state, sizeof(rd->state), &rd->buf);
+	s->alg_data = rd;
 }
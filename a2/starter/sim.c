@@ -4,15 +4,29 @@
 #include <getopt.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "sim.h"
 #include "pagetable.h"
+#include "mrc.h"
+#include "tlb.h"
+#include "huge.h"
+#include "policy.h"
+#include "prefetch.h"
+#include "concurrent.h"
+#include "evlog.h"
 
 // Define global variables declared in sim.h
-unsigned memsize = 0;
 int debug = 0;
-char *physmem = NULL;
-struct frame *coremap = NULL;
 char *tracefile = NULL;
+unsigned opt_window = 0;
+struct swap_backend *swap_backend = NULL;
+unsigned tlb_entries = 0;
+unsigned tlb_ways = 0;
+int tlb_repl = TLB_LRU;
+unsigned huge_frames = 0;
+unsigned huge_promote = 64;
+unsigned ws_tau = 1000;
+unsigned rss_interval = 0;
 
 /* The algs array gives us a mapping between the name of an eviction
  * algorithm as given in a command line argument, and the function to
@@ -23,15 +37,121 @@ struct functions algs[] = {
 	{"lru", lru_init, lru_ref, lru_evict},
 	{"fifo", fifo_init, fifo_ref, fifo_evict},
 	{"clock",clock_init, clock_ref, clock_evict},
-	{"opt", opt_init, opt_ref, opt_evict}
+	{"opt", opt_init, opt_ref, opt_evict},
+	{"arc", arc_init, arc_ref, arc_evict},
+	{"clockpro", clockpro_init, clockpro_ref, clockpro_evict},
+	{"2q", twoq_init, twoq_ref, twoq_evict},
+	{"aging", aging_init, aging_ref, aging_evict},
+	{"ws", ws_init, ws_ref, ws_evict},
+	{"pff", pff_init, pff_ref, pff_evict}
 };
-int num_algs = 5;
+int num_algs = 11;
 
-void (*init_fcn)() = NULL;
-void (*ref_fcn)(pgtbl_entry_t *) = NULL;
-int (*evict_fcn)() = NULL;
+#define MAXINSTANCES 256
 
 
+/* Creates a simulator instance with its own physical memory, coremap,
+ * page table and swap, and initializes its replacement algorithm.
+ */
+static struct sim *sim_new(struct functions *alg, unsigned memsize,
+                           unsigned swapsize, trace_t *trace) {
+	struct sim *s = calloc(1, sizeof(struct sim));
+
+	// Initialize main data structures for simulation.
+	// This happens before calling the replacement algorithm init function
+	// so that the init function can refer to the coremap if needed.
+	s->memsize = memsize;
+	s->alg = alg;
+	s->trace = trace;
+	s->coremap = calloc(memsize, sizeof(struct frame));
+	s->free_frames = malloc(memsize * sizeof(int));
+	for (s->nfree = 0; s->nfree < memsize; s->nfree++) {
+		s->free_frames[s->nfree] = memsize - 1 - s->nfree;
+	}
+	s->physmem = malloc(memsize * SIMPAGESIZE);
+	s->swap = swap_init(swapsize, swap_backend);
+	if (tlb_entries > 0) {
+		s->tlb = tlb_create(tlb_entries, tlb_ways, tlb_repl);
+	}
+	if (huge_frames > 0) {
+		s->huge = huge_create(huge_frames, huge_promote);
+	}
+	init_pagetable(s);
+
+	// Call replacement algorithm's init function before replaying trace.
+	alg->init(s);
+	return s;
+}
+
+/* Creates an instance as above, with the prefetcher if there is one (-P)
+ * and a baseline twin that replays the same references without it.
+ */
+struct sim *sim_create(struct functions *alg, unsigned memsize,
+                       unsigned swapsize, trace_t *trace) {
+	struct sim *s = sim_new(alg, memsize, swapsize, trace);
+
+	if (prefetcher != NULL) {
+		s->prefetch = prefetch_create(prefetcher, prefetch_degree);
+		s->baseline = sim_new(alg, memsize, swapsize, trace);
+	}
+	return s;
+}
+
+/* Frees an instance. Replacement algorithms without a destroy hook leave
+ * their alg_data for process exit.
+ */
+void sim_destroy(struct sim *s) {
+	if (s->alg->destroy != NULL) {
+		s->alg->destroy(s);
+	}
+	// Cleanup - removes temporary swapfile.
+	swap_destroy(s->swap);
+	if (s->tlb != NULL) {
+		tlb_destroy(s->tlb);
+	}
+	if (s->huge != NULL) {
+		huge_destroy(s->huge);
+	}
+	if (s->prefetch != NULL) {
+		prefetch_destroy(s->prefetch);
+		sim_destroy(s->baseline);
+	}
+	if (s->evlog != NULL) {
+		evlog_close(s->evlog);
+	}
+	destroy_pagetable(s);
+	free(s->coremap);
+	free(s->free_frames);
+	free(s->physmem);
+	free(s->samples);
+	free(s);
+}
+
+
+/* Records every process' resident set size, and its references and faults
+ * since the last sample.
+ */
+void sample_rss(struct sim *s) {
+	int i;
+
+	s->samples = realloc(s->samples,
+	                     (s->nsamples + s->nprocs) * sizeof(struct rss_sample));
+	for (i = 0; i < s->nprocs; i++) {
+		struct proc *p = s->procs[i];
+		if (p->ref_count == 0) {
+			continue;
+		}
+		struct rss_sample *r = &s->samples[s->nsamples++];
+		r->time = s->ref_count;
+		r->pid = p->pid;
+		r->resident = p->resident;
+		r->refs = p->ref_count - p->sample_ref_count;
+		r->faults = p->miss_count - p->sample_miss_count;
+		p->sample_ref_count = p->ref_count;
+		p->sample_miss_count = p->miss_count;
+	}
+}
+
 /* An actual memory access based on the vaddr from the trace file.
  *
  * The find_physpage() function is called to translate the virtual address
@@ -45,9 +165,16 @@ int (*evict_fcn)() = NULL;
  * We then check that the memory has the expected content (just a copy of the
  * virtual address) and, in case of a write reference, increment the version
  * counter. 
+ *
+ * The reference is made in process pid's address space, so we switch to it
+ * first if the previous reference was from another process.
  */
-void access_mem(char type, addr_t vaddr) {
-	char *memptr = find_physpage(vaddr, type);
+void access_mem(struct sim *s, char type, addr_t vaddr, unsigned pid) {
+	if (pid != s->proc->pid) {
+		switch_process(s, pid);
+	}
+
+	char *memptr = find_physpage(s, vaddr, type);
 	int *versionptr = (int *)memptr;
 	addr_t *checkaddr = (addr_t *)(memptr + sizeof(int));
 
@@ -60,25 +187,343 @@ void access_mem(char type, addr_t vaddr) {
 		(*versionptr)++;
 	}
 
+	if (rss_interval != 0 && s->ref_count % rss_interval == 0) {
+		sample_rss(s);
+	}
+
+	if (s->baseline != NULL) {
+		access_mem(s->baseline, type, vaddr, pid);
+	}
 }
 
 
-void replay_trace(FILE *infp) {
-	char buf[MAXLINE];
+/* Replays the trace once, feeding every reference to each miss-ratio curve
+ * instead of simulating it.
+ */
+void replay_curves(trace_t *tp, struct mrc **curves, int ncurves) {
 	addr_t vaddr = 0;
+	unsigned pid;
 	char type;
+	int i;
+
+	while(trace_next(tp, &type, &vaddr, &pid)) {
+		for (i = 0; i < ncurves; i++) {
+			mrc_ref(curves[i], trace_page(pid, vaddr));
+		}
+	}
+}
+
+/* Replays every reference in the trace. The trace may be in the text format
+ * produced by traceprogs/runit or in the binary format produced by tracecvt;
+ * trace_open() detects which.
+ *
+ * The trace is parsed once and each reference is fed to every instance in
+ * sims, in order.
+ */
+void replay_trace(trace_t *tp, struct sim **sims, int nsims) {
+	addr_t vaddr = 0;
+	unsigned pid;
+	char type;
+	int i;
+
+	while(trace_next(tp, &type, &vaddr, &pid)) {
+		if(debug)  {
+			printf("%c %lx %u\n", type, vaddr, pid);
+		}
+		for (i = 0; i < nsims; i++) {
+			access_mem(sims[i], type, vaddr, pid);
+		}
+	}
+}
+
+/* Instances replayed in parallel by -j worker threads. Each instance has its
+ * own reader over the same in-memory trace and touches no state shared with
+ * other instances, so workers only synchronize to claim the next instance.
+ */
+struct sweep {
+	struct sim **sims;
+	int nsims;
+	int next;                // Next instance to hand out
+	pthread_mutex_t lock;
+};
+
+void *sweep_worker(void *arg) {
+	struct sweep *sw = arg;
+	int i;
+
+	while (1) {
+		pthread_mutex_lock(&sw->lock);
+		i = sw->next++;
+		pthread_mutex_unlock(&sw->lock);
+		if (i >= sw->nsims) {
+			return NULL;
+		}
+		replay_trace(sw->sims[i]->trace, &sw->sims[i], 1);
+	}
+}
+
+void replay_parallel(struct sim **sims, int nsims, int nthreads) {
+	pthread_t *threads = malloc(nthreads * sizeof(pthread_t));
+	struct sweep sw;
+	int i;
+
+	sw.sims = sims;
+	sw.nsims = nsims;
+	sw.next = 0;
+	pthread_mutex_init(&sw.lock, NULL);
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&threads[i], NULL, sweep_worker, &sw) != 0) {
+			perror("Failed to create worker thread");
+			exit(1);
+		}
+	}
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	pthread_mutex_destroy(&sw.lock);
+	free(threads);
+}
 
-	while(fgets(buf, MAXLINE, infp) != NULL) {
-		if(buf[0] != '=') {
-			sscanf(buf, "%c %lx", &type, &vaddr);
-			if(debug)  {
-				printf("%c %lx\n", type, vaddr);
+/* Parses a comma-separated list of memory sizes, where each item is either
+ * a size or a range start:end:step (inclusive), into memsizes.
+ * Returns the number of sizes.
+ */
+int parse_memsizes(char *list, unsigned *memsizes, int max) {
+	int n = 0;
+	char *tok, *save;
+
+	for (tok = strtok_r(list, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+		unsigned start, end, step, m;
+		int fields = sscanf(tok, "%u:%u:%u", &start, &end, &step);
+		if (fields == 1) {
+			end = start;
+			step = 1;
+		} else if (fields == 2) {
+			step = 1;
+		}
+		if (fields < 1 || step == 0) {
+			fprintf(stderr, "Error: invalid memory size - %s\n", tok);
+			exit(1);
+		}
+		if (start > MAXMEMSIZE || end > MAXMEMSIZE) {
+			fprintf(stderr, "Error: at most %d frames of memory - %s\n", MAXMEMSIZE, tok);
+			exit(1);
+		}
+		for (m = start; m <= end; m += step) {
+			if (n == max) {
+				fprintf(stderr, "Error: at most %d memory sizes\n", max);
+				exit(1);
 			}
-			access_mem(type, vaddr);
-		} else {
+			memsizes[n++] = m;
+		}
+	}
+	return n;
+}
+
+/* Looks up a built-in algorithm by name, or loads a plugin if name is a
+ * path (contains a '/').
+ */
+struct functions *find_alg(char *name) {
+	int i;
+	if (strchr(name, '/') != NULL) {
+		return policy_load(name);
+	}
+	for (i = 0; i < num_algs; i++) {
+		if(strcmp(algs[i].name, name) == 0) {
+			return &algs[i];
+		}
+	}
+	return NULL;
+}
+
+// One row per process, for traces with more than one
+void print_procs(struct sim *s) {
+	int i;
+	printf("%8s %10s %10s %10s %10s %10s %9s\n", "pid", "refs", "hits",
+	       "misses", "clean", "dirty", "hit rate");
+	for (i = 0; i < s->nprocs; i++) {
+		struct proc *p = s->procs[i];
+		if (p->ref_count == 0 && p->evict_clean_count + p->evict_dirty_count == 0) {
 			continue;
 		}
+		printf("%8u %10d %10d %10d %10d %10d %9.4f\n", p->pid, p->ref_count,
+		       p->hit_count, p->miss_count, p->evict_clean_count,
+		       p->evict_dirty_count,
+		       p->ref_count ? (double)p->hit_count/p->ref_count * 100 : 0.0);
+	}
+}
+
+// The resident set time series as CSV, one row per process per sample
+void print_samples(struct sim *s) {
+	int i;
+	printf("time,pid,resident,refs,faults,fault_rate\n");
+	for (i = 0; i < s->nsamples; i++) {
+		struct rss_sample *r = &s->samples[i];
+		printf("%d,%u,%d,%d,%d,%.4f\n", r->time, r->pid, r->resident, r->refs,
+		       r->faults, r->refs ? (double)r->faults / r->refs : 0.0);
+	}
+}
+
+/* Prefetched pages that were referenced before being evicted, out of all
+ * pages prefetched, and out of all the misses there would otherwise have
+ * been. Pages still resident and unreferenced at the end count against
+ * accuracy.
+ */
+double prefetch_accuracy(struct sim *s) {
+	return s->prefetch_count ?
+	       (double)s->prefetch_hit_count/s->prefetch_count * 100 : 0.0;
+}
+
+double prefetch_coverage(struct sim *s) {
+	int misses = s->prefetch_hit_count + s->miss_count;
+	return misses ? (double)s->prefetch_hit_count/misses * 100 : 0.0;
+}
+
+// Hit rate gained over the baseline twin, which also counts the misses
+// caused by prefetched pages pushing out useful ones
+double prefetch_net_change(struct sim *s) {
+	return (double)(s->hit_count - s->baseline->hit_count)/s->ref_count * 100;
+}
+
+void print_counts(struct sim *s) {
+	printf("\n");
+	printf("Hit count: %d\n", s->hit_count);
+	printf("Miss count: %d\n", s->miss_count);
+	printf("Clean evictions: %d\n", s->evict_clean_count);
+	printf("Dirty evictions: %d\n", s->evict_dirty_count); 
+	printf("Total references : %d\n", s->ref_count);
+	printf("Hit rate: %.4f\n", (double)s->hit_count/s->ref_count * 100);
+	printf("Miss rate: %.4f\n", (double)s->miss_count/s->ref_count *100);
+	if (s->tlb != NULL) {
+		printf("TLB hit rate: %.4f\n",
+		       (double)tlb_hits(s->tlb)/s->ref_count * 100);
+	}
+	if (s->huge != NULL) {
+		unsigned long huge_faults = huge_fault_count(s->huge);
+		printf("Huge page faults: %lu\n", huge_faults);
+		printf("Base page faults: %lu\n", s->miss_count - huge_faults);
+		printf("Huge clean evictions: %lu\n", huge_evict_clean_count(s->huge));
+		printf("Huge dirty evictions: %lu\n", huge_evict_dirty_count(s->huge));
+		printf("Huge page swap-ins: %lu\n", huge_swapin_count(s->huge));
+		printf("Huge page fragmentation: %.4f (%lu KB never touched)\n",
+		       huge_faults == 0 ? 0.0 : (double)huge_untouched(s->huge) /
+		       (huge_faults * HUGE_PAGES) * 100,
+		       huge_untouched(s->huge) * (PAGE_SIZE / 1024));
+	}
+	printf("Page table memory: %lu KB\n", s->pgtbl_bytes / 1024);
+	if (cost_model != NULL) {
+		cost_print(&s->cost, s->ref_count);
+	}
+	if (s->prefetch != NULL) {
+		printf("Prefetched pages: %d\n", s->prefetch_count);
+		printf("Useful prefetches: %d\n", s->prefetch_hit_count);
+		printf("Wasted prefetches: %d\n", s->prefetch_wasted_count);
+		printf("Prefetch accuracy: %.4f\n", prefetch_accuracy(s));
+		printf("Prefetch coverage: %.4f\n", prefetch_coverage(s));
+		printf("Hit rate without prefetching: %.4f\n",
+		       (double)s->baseline->hit_count/s->ref_count * 100);
+		printf("Net hit rate change: %+.4f\n", prefetch_net_change(s));
+	}
+	if (s->nprocs > 1) {
+		printf("\nPer-process counts (evictions are of that process' pages):\n");
+		print_procs(s);
+	}
+	if (rss_interval != 0) {
+		printf("\nResident set every %u references:\n", rss_interval);
+		print_samples(s);
+	}
+}
+
+/* Sets prefetcher and prefetch_degree from "kind[:degree]".
+ * Returns 0 on success, -1 if the spec is malformed.
+ */
+int parse_prefetch(char *spec) {
+	char *colon = strchr(spec, ':');
+	char *end;
+
+	if (colon != NULL) {
+		*colon = '\0';
+	}
+	prefetcher = prefetch_find(spec);
+	if (colon != NULL) {
+		*colon = ':';
+		prefetch_degree = (unsigned)strtoul(colon + 1, &end, 10);
+		if (*end != '\0' || prefetch_degree == 0 ||
+		    prefetch_degree > PREFETCH_MAX_DEGREE) {
+			return -1;
+		}
+	}
+	return prefetcher != NULL ? 0 : -1;
+}
+
+/* Sets tlb_entries, tlb_ways and tlb_repl from "entries[:ways[:policy]]".
+ * Returns 0 on success, -1 if the spec is malformed.
+ */
+int parse_tlb(char *spec) {
+	char *end;
+	struct tlb *t;
 
+	tlb_entries = (unsigned)strtoul(spec, &end, 10);
+	tlb_ways = tlb_entries;
+	tlb_repl = TLB_LRU;
+	if (*end == ':') {
+		tlb_ways = (unsigned)strtoul(end + 1, &end, 10);
+		if (*end == ':') {
+			if ((tlb_repl = tlb_policy(end + 1)) == -1) {
+				return -1;
+			}
+			end += strlen(end);
+		}
+	}
+	if (*end != '\0' || (t = tlb_create(tlb_entries, tlb_ways, tlb_repl)) == NULL) {
+		return -1;
+	}
+	tlb_destroy(t);
+	return 0;
+}
+
+// One row per instance, for runs with several algorithms or memory sizes
+void print_table(struct sim **sims, int nsims) {
+	int i;
+	printf("%-10s %8s %10s %10s %10s %10s %9s", "algorithm", "memsize",
+	       "hits", "misses", "clean", "dirty", "hit rate");
+	printf(tlb_entries > 0 ? " %9s" : "", "tlb hit");
+	printf(huge_frames > 0 ? " %10s" : "", "huge flts");
+	printf(cost_model != NULL ? " %10s %12s" : "", "amat ns", "sim time ms");
+	printf(prefetcher != NULL ? " %9s %9s %9s\n" : "\n", "pf acc", "pf cov",
+	       "net hit");
+	for (i = 0; i < nsims; i++) {
+		struct sim *s = sims[i];
+		printf("%-10s %8u %10d %10d %10d %10d %9.4f", s->alg->name,
+		       s->memsize, s->hit_count, s->miss_count, s->evict_clean_count,
+		       s->evict_dirty_count, (double)s->hit_count/s->ref_count * 100);
+		if (s->tlb != NULL) {
+			printf(" %9.4f", (double)tlb_hits(s->tlb)/s->ref_count * 100);
+		}
+		if (s->huge != NULL) {
+			printf(" %10lu", huge_fault_count(s->huge));
+		}
+		if (cost_model != NULL) {
+			printf(" %10.1f %12.3f", (double)s->cost.total_ns/s->ref_count,
+			       s->cost.total_ns / 1e6);
+		}
+		if (s->prefetch != NULL) {
+			printf(" %9.4f %9.4f %+9.4f", prefetch_accuracy(s),
+			       prefetch_coverage(s), prefetch_net_change(s));
+		}
+		printf("\n");
+	}
+	for (i = 0; i < nsims; i++) {
+		if (sims[i]->nprocs > 1) {
+			printf("\n%s, memsize %u, per process:\n", sims[i]->alg->name,
+			       sims[i]->memsize);
+			print_procs(sims[i]);
+		}
+		if (rss_interval != 0) {
+			printf("\n%s, memsize %u, resident set every %u references:\n",
+			       sims[i]->alg->name, sims[i]->memsize, rss_interval);
+			print_samples(sims[i]);
+		}
 	}
 }
 
@@ -86,17 +531,55 @@ void replay_trace(FILE *infp) {
 int main(int argc, char *argv[]) {
 	int opt;
 	unsigned swapsize = 4096;
-	FILE *tfp = stdin;
 	char *replacement_alg = NULL;
-	char *usage = "USAGE: sim -f tracefile -m memorysize -s swapsize -a algorithm\n";
+	char *memsize_list = NULL;
+	char *event_file = NULL;
+	unsigned event_sample = 1;
+	char *end;
+	int nthreads = 1;
+	int nreplayers = 0;
+	trace_t *trace;
+	struct trace_buf *buf = NULL;
+	char *usage = "USAGE: sim -f tracefile -m memorysize -s swapsize -a algorithm [-w window] [-j threads] [-S file|mem|mmap|async] [-L 2|3|4]\n"
+	              "           [-T entries[:ways[:lru|fifo|rand]]] [-H frames[:touches]] [-C default|name=ns,...]\n"
+	              "           [-t tau] [-R interval] [-P next|stride|markov[:degree]] [-c threads] [-E eventlog[:N]]\n"
+	              "       -m and -a also take comma-separated lists, e.g. -m 50,100:500:100 -a lru,opt,\n"
+	              "       to replay the trace once for every combination\n"
+	              "       -j replays the combinations on that many threads\n"
+	              "       -c replays each combination on that many threads at once, sharing\n"
+	              "          its memory; only with clock, rand or aging (see concurrent.h)\n"
+	              "       -S keeps swapped pages in a file (default), memory, an mmapped file,\n"
+	              "          or a file written behind in batches\n"
+	              "       -a lru-mrc,opt-mrc prints misses for 1..memorysize frames as CSV\n"
+	              "       -a also loads policy plugins by path, e.g. -a ./libpolicy_fifo.so\n"
+	              "          (see policy.h)\n"
+	              "       -L walks a 2 level (default), or a 3 or 4 level x86-64 style page table\n"
+	              "       -T puts a TLB in front of the page table, fully associative and\n"
+	              "          lru unless given, e.g. -T 64:4:lru; a huge page takes one entry\n"
+	              "       -H adds that many 2MB huge page frames (needs -L 3 or 4), promoting a\n"
+	              "          region once that many of its pages are touched (default 64)\n"
+	              "       -C estimates time spent on memory accesses, with default latencies\n"
+	              "          or overriding some of hit, tlb, minor, major, clean and dirty\n"
+	              "          (in ns, see cost.c), e.g. -C major=50000,dirty=80000\n"
+	              "       -t sets the window of -a ws and the fault interval of -a pff, in\n"
+	              "          references made by the process (default 1000)\n"
+	              "       -R prints each process' resident set size and fault rate every\n"
+	              "          that many references\n"
+	              "       -P prefetches up to degree (default 4) more pages on each miss:\n"
+	              "          the next pages, the next pages at a repeating stride, or the\n"
+	              "          pages that missed after this one before (see prefetch.h)\n"
+	              "       -E logs every hit, miss, eviction and swap read or write to a\n"
+	              "          binary file (named eventlog.<alg>.<memsize> if there are several\n"
+	              "          instances), which evsum summarizes; with N, only those of 1 in N\n"
+	              "          pages, for less overhead\n";
 
-	while ((opt = getopt(argc, argv, "f:m:a:s:")) != -1) {
+	while ((opt = getopt(argc, argv, "f:m:a:s:w:j:c:S:L:T:H:C:t:R:P:E:")) != -1) {
 		switch (opt) {
 		case 'f':
 			tracefile = optarg;
 			break;
 		case 'm':
-			memsize = (unsigned)strtoul(optarg, NULL, 10);
+			memsize_list = optarg;
 			break;
 		case 'a':
 			replacement_alg = optarg;
@@ -104,63 +587,249 @@ int main(int argc, char *argv[]) {
 		case 's':
 			swapsize = (unsigned)strtoul(optarg, NULL, 10);
 			break;
+		case 'w':
+			opt_window = (unsigned)strtoul(optarg, NULL, 10);
+			break;
+		case 'j':
+			nthreads = (int)strtol(optarg, NULL, 10);
+			break;
+		case 'c':
+			nreplayers = (int)strtol(optarg, &end, 10);
+			if (*end != '\0' || nreplayers < 1) {
+				fprintf(stderr, "Error: invalid number of threads - %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'E':
+			event_file = optarg;
+			// Only a trailing ":N" of digits is a sampling rate, so paths
+			// with colons of their own (run:1.log, /tmp/a:b/ev) still work
+			optarg = strrchr(optarg, ':');
+			if (optarg != NULL && optarg[1] != '\0' &&
+			    optarg[1 + strspn(optarg + 1, "0123456789")] == '\0') {
+				*optarg++ = '\0';
+				event_sample = (unsigned)strtoul(optarg, &end, 10);
+				if (*end != '\0' || event_sample == 0) {
+					fprintf(stderr, "Error: invalid event log sampling - %s\n", optarg);
+					exit(1);
+				}
+			}
+			break;
+		case 'S':
+			if ((swap_backend = swap_find_backend(optarg)) == NULL) {
+				fprintf(stderr, "Error: invalid swap backend - %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'L':
+			pgtbl_levels = (int)strtol(optarg, NULL, 10);
+			if (find_pgtbl_layout(pgtbl_levels) == NULL) {
+				fprintf(stderr, "Error: invalid page table levels - %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'T':
+			if (parse_tlb(optarg) != 0) {
+				fprintf(stderr, "Error: invalid TLB - %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'H':
+			huge_frames = (unsigned)strtoul(optarg, &end, 10);
+			if (*end == ':') {
+				huge_promote = (unsigned)strtoul(end + 1, &end, 10);
+			}
+			if (*end != '\0' || huge_promote == 0 || huge_promote > HUGE_PAGES) {
+				fprintf(stderr, "Error: invalid huge pages - %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 't':
+			ws_tau = (unsigned)strtoul(optarg, &end, 10);
+			if (*end != '\0' || ws_tau == 0) {
+				fprintf(stderr, "Error: invalid tau - %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'R':
+			rss_interval = (unsigned)strtoul(optarg, &end, 10);
+			if (*end != '\0') {
+				fprintf(stderr, "Error: invalid sample interval - %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'P':
+			if (parse_prefetch(optarg) != 0) {
+				fprintf(stderr, "Error: invalid prefetcher - %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'C':
+			if (cost_parse(optarg) != 0) {
+				fprintf(stderr, "Error: invalid cost model - %s\n", optarg);
+				exit(1);
+			}
+			break;
 		default:
 			fprintf(stderr, "%s", usage);
 			exit(1);
 		}
 	}
-	if(tracefile != NULL) {
-		if((tfp = fopen(tracefile, "r")) == NULL) {
-			perror("Error opening tracefile:");
-			exit(1);
+	if(replacement_alg == NULL) {
+		fprintf(stderr, "%s", usage);
+		exit(1);
+	}
+	const struct pgtbl_layout *layout = find_pgtbl_layout(pgtbl_levels);
+	if (huge_frames > 0 &&
+	    layout->entries[layout->levels - 1] != HUGE_PAGES) {
+		fprintf(stderr, "Error: huge pages need a page table whose last level maps 2MB (-L 3 or 4)\n");
+		exit(1);
+	}
+	// Concurrent replay only covers the page table and swap
+	if (nreplayers > 0 && (nthreads > 1 || tlb_entries > 0 || huge_frames > 0 ||
+	                       prefetcher != NULL || rss_interval != 0 ||
+	                       cost_model != NULL || event_file != NULL)) {
+		fprintf(stderr, "Error: -c can't be combined with -j, -T, -H, -P, -R, -C or -E\n");
+		exit(1);
+	}
+	if((trace = trace_open(tracefile)) == NULL) {
+		perror("Error opening tracefile:");
+		exit(1);
+	}
+
+	// Parse the memory sizes
+	unsigned memsizes[MAXINSTANCES];
+	unsigned max_memsize = 0;
+	int nmemsizes = 0;
+	int i;
+	char *tok;
+	if (memsize_list != NULL) {
+		nmemsizes = parse_memsizes(memsize_list, memsizes, MAXINSTANCES);
+	}
+	for (i = 0; i < nmemsizes; i++) {
+		if (memsizes[i] > max_memsize) {
+			max_memsize = memsizes[i];
 		}
 	}
 
-	// Initialize main data structures for simulation.
-	// This happens before calling the replacement algorithm init function
-	// so that the init_fcn can refer to the coremap if needed.
-	coremap = calloc(memsize, sizeof(struct frame));
-	physmem = malloc(memsize * SIMPAGESIZE);
-	swap_init(swapsize);
-	init_pagetable();
+	// Worker threads share one parsed copy of the trace
+	if (nthreads > 1 || nreplayers > 0) {
+		buf = trace_load(trace);
+		trace_close(trace);
+		trace = trace_open_buf(buf);
+	}
 
-	// Initialize replacement algorithm functions.
-	if(replacement_alg == NULL) {
-		fprintf(stderr, "%s", usage);
-		exit(1);
-	} else {
-		int i;
-		for (i = 0; i < num_algs; i++) {
-			if(strcmp(algs[i].name, replacement_alg) == 0) {
-				init_fcn = algs[i].init;
-				ref_fcn = algs[i].ref;
-				evict_fcn = algs[i].evict;
-				break;
+	// Create an instance for every algorithm and memory size, or a curve
+	// (up to the largest memory size, if any) for every -mrc algorithm
+	struct sim *sims[MAXINSTANCES];
+	struct mrc *curves[MAXINSTANCES];
+	int nsims = 0;
+	int ncurves = 0;
+	for (tok = strtok(replacement_alg, ","); tok != NULL; tok = strtok(NULL, ",")) {
+		if (mrc_kind(tok) != -1) {
+			if (ncurves == MAXINSTANCES) {
+				fprintf(stderr, "Error: at most %d curves\n", MAXINSTANCES);
+				exit(1);
 			}
+			curves[ncurves++] = mrc_create(mrc_kind(tok), max_memsize);
+			continue;
 		}
-		if(evict_fcn == NULL) {
+		struct functions *alg = find_alg(tok);
+		if(alg == NULL) {
 			fprintf(stderr, "Error: invalid replacement algorithm - %s\n", 
-					replacement_alg);
+					tok);
+			exit(1);
+		}
+		// OPT's future knowledge is indexed by reference, and prefetched
+		// pages would reach it as references that aren't in the trace
+		if (prefetcher != NULL && alg->ref == opt_ref) {
+			fprintf(stderr, "Error: opt can't be combined with prefetching (-P)\n");
+			exit(1);
+		}
+		// Concurrent replay only runs hits in parallel for algorithms
+		// that see them through PG_REF alone; the rest would be serial
+		if (nreplayers > 0 && !replay_concurrent_supported(alg)) {
+			fprintf(stderr, "Error: -c needs clock, rand or aging, not %s\n",
+			        alg->name);
+			exit(1);
+		}
+		// Nor with huge pages, whose references never reach opt_ref(), and
+		// whose regions leave stale base pages that OPT still sees a use for
+		if (huge_frames > 0 && alg->ref == opt_ref) {
+			fprintf(stderr, "Error: opt can't be combined with huge pages (-H)\n");
 			exit(1);
 		}
+		for (i = 0; i < nmemsizes; i++) {
+			if (nsims == MAXINSTANCES) {
+				fprintf(stderr, "Error: at most %d instances\n", MAXINSTANCES);
+				exit(1);
+			}
+			sims[nsims++] = sim_create(alg, memsizes[i], swapsize,
+			                           nthreads > 1 ? trace_open_buf(buf) : trace);
+		}
+	}
+	if (ncurves > 0 && nsims > 0) {
+		fprintf(stderr, "Error: -mrc algorithms can't be mixed with others\n");
+		exit(1);
+	}
+	if (ncurves == 0 && nmemsizes == 0) {
+		fprintf(stderr, "%s", usage);
+		exit(1);
 	}
-	// Call replacement algorithm's init_fcn before replaying trace.
-	init_fcn();
 
-	replay_trace(tfp);
-	print_pagedirectory();
+	// Each instance writes its own event log
+	for (i = 0; event_file != NULL && i < nsims; i++) {
+		char path[MAXLINE];
+		if (nsims == 1) {
+			snprintf(path, sizeof(path), "%s", event_file);
+		} else {
+			snprintf(path, sizeof(path), "%s.%s.%u", event_file,
+			         sims[i]->alg->name, sims[i]->memsize);
+		}
+		if ((sims[i]->evlog = evlog_open(path, event_sample)) == NULL) {
+			perror("Error opening event log");
+			exit(1);
+		}
+	}
 
-	// Cleanup - removes temporary swapfile.
-	swap_destroy();
+	if (ncurves > 0) {
+		replay_curves(trace, curves, ncurves);
+		trace_close(trace);
+		mrc_print_csv(stdout, curves, ncurves);
+		for (i = 0; i < ncurves; i++) {
+			mrc_destroy(curves[i]);
+		}
+		return(0);
+	}
 
-	printf("\n");
-	printf("Hit count: %d\n", hit_count);
-	printf("Miss count: %d\n", miss_count);
-	printf("Clean evictions: %d\n",evict_clean_count);
-	printf("Dirty evictions: %d\n",evict_dirty_count); 
-	printf("Total references : %d\n", ref_count);
-	printf("Hit rate: %.4f\n", (double)hit_count/ref_count * 100);
-	printf("Miss rate: %.4f\n", (double)miss_count/ref_count *100);
+	if (nreplayers > 0) {
+		for (i = 0; i < nsims; i++) {
+			replay_concurrent(sims[i], buf, nreplayers);
+		}
+		trace_close(trace);
+		trace_buf_destroy(buf);
+	} else if (buf != NULL) {
+		replay_parallel(sims, nsims, nthreads);
+		for (i = 0; i < nsims; i++) {
+			trace_close(sims[i]->trace);
+		}
+		trace_close(trace);
+		trace_buf_destroy(buf);
+	} else {
+		replay_trace(trace, sims, nsims);
+		trace_close(trace);
+	}
+
+	if (nsims == 1) {
+		print_pagedirectory(sims[0]);
+		print_counts(sims[0]);
+	} else {
+		print_table(sims, nsims);
+	}
+
+	for (i = 0; i < nsims; i++) {
+		sim_destroy(sims[i]);
+	}
 		
 	return(0);
 }
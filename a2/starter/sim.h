@@ -2,38 +2,198 @@
 #define __SIM_H__
 
 #include "pagetable.h"
+#include "trace.h"
+#include "cost.h"
 #define MAXLINE 256
-#define SIMPAGESIZE 16  /* Simulated physical memory page frame size */
+#define MAXMEMSIZE (1 << 27) /* Frames, so frame * SIMPAGESIZE fits an int */
 
-extern unsigned memsize;
 extern int debug;
 
-extern int hit_count;
-extern int miss_count;
-extern int ref_count;
-extern int evict_clean_count;
-extern int evict_dirty_count;
-
-/* We simulate physical memory with a large array of bytes */
-extern char *physmem;
-
 /* The tracefile name is a global variable because the OPT
  * algorithm will need to read the file before you start
  * replaying the trace.
  */
 extern char *tracefile;
 
+/* Number of future references OPT may look at (-w); 0 means the whole
+ * trace, which is read in advance from tracefile.
+ */
+extern unsigned opt_window;
+
+/* Where instances keep swapped-out pages (-S); NULL means the file backend.
+ */
+extern struct swap_backend *swap_backend;
+
+/* Simulated TLB size, associativity and replacement policy (-T); 0 entries
+ * means no TLB.
+ */
+extern unsigned tlb_entries;
+extern unsigned tlb_ways;
+extern int tlb_repl;
+
+/* Number of 2MB huge page frames, and how many of a region's 4KB pages are
+ * touched before it is promoted to one (-H); 0 frames means no huge pages.
+ */
+extern unsigned huge_frames;
+extern unsigned huge_promote;
+
+/* The working set window of the ws algorithm, and the fault interval above
+ * which pff shrinks a process' resident set, in references made by that
+ * process (-t).
+ */
+extern unsigned ws_tau;
+
+/* Every how many references each process' resident set size and fault
+ * rate are sampled (-R); 0 means never.
+ */
+extern unsigned rss_interval;
+
 // Each eviction algorithm is represented by a structure with its name
-// and three functions.
+// and three functions, plus optional hooks that may be left NULL. Each
+// function is passed the simulator instance it is working on; any state
+// the algorithm keeps belongs in s->alg_data.
 struct functions {
-	char *name;                  // String name of eviction algorithm
-	void (*init)(void);          // Initialize any data needed by alg
-	void (*ref)(pgtbl_entry_t *);    // Called on each reference
-	int (*evict)();              // Called to choose victim for eviction
+	char *name;                                 // String name of eviction algorithm
+	void (*init)(struct sim *);                 // Initialize any data needed by alg
+	void (*ref)(struct sim *, pgtbl_entry_t *); // Called on each reference
+	int (*evict)(struct sim *);                 // Called to choose victim for eviction
+
+	void (*destroy)(struct sim *);              // Free alg_data
+	void (*on_alloc)(struct sim *, int, pgtbl_entry_t *); // Page given a frame
+	void (*on_evict)(struct sim *, int, pgtbl_entry_t *); // Page evicted from frame
+	void (*on_hit)(struct sim *, int, pgtbl_entry_t *);   // Before ref, if resident
+	void (*on_miss)(struct sim *, int, pgtbl_entry_t *);  // Before ref, if faulted in
+
+	const struct policy *plugin;                // Set by policy_load()
+};
+
+extern struct functions algs[];
+extern int num_algs;
+
+/* One process in the trace. Each has its own page directory; the processes
+ * of an instance share its coremap, physical memory, swap and replacement
+ * algorithm, so replacement is global.
+ */
+struct proc {
+	unsigned pid;
+	pgdir_entry_t *pgdir;
+	int resident;             // Frames holding this process' pages
+	void *alg_data;           // Replacement algorithm's per-process state,
+	                          // freed with the process
+
+	// Counters for this process' references, and evictions of its pages
+	int hit_count;
+	int miss_count;
+	int ref_count;
+	int evict_clean_count;
+	int evict_dirty_count;
+
+	// ref_count and miss_count at the last resident set sample (-R)
+	int sample_ref_count;
+	int sample_miss_count;
+};
+
+/* A process' resident set size, and its references and faults since the
+ * previous sample, every rss_interval references (-R).
+ */
+struct rss_sample {
+	int time;
+	unsigned pid;
+	int resident;
+	int refs;
+	int faults;
 };
 
-extern void (*init_fcn)();
-extern void (*ref_fcn)(pgtbl_entry_t *);
-extern int (*evict_fcn)();
+/* One simulated machine: its physical memory, coremap, page table, swap
+ * and replacement algorithm, plus the event counters for its run.
+ * Several instances can replay the same trace side by side, each with its
+ * own algorithm and memory size.
+ */
+struct sim {
+	unsigned memsize;
+	struct functions *alg;
+	void *alg_data;           // Replacement algorithm's private state
+
+	/* The trace this instance replays. OPT's windowed mode reads ahead of
+	 * the replay through it instead of reopening tracefile, so it also
+	 * works when the trace is piped in on stdin.
+	 */
+	trace_t *trace;
+
+	/* We simulate physical memory with a large array of bytes */
+	char *physmem;
+
+	/* The coremap holds information about physical memory.
+	 * The index into coremap is the physical page frame number stored
+	 * in the page table entry (pgtbl_entry_t).
+	 */
+	struct frame *coremap;
+
+	// Page being faulted in while alg->evict runs, for policies whose
+	// choice of victim depends on it
+	pgtbl_entry_t *fault_pte;
+
+	// Stack of frames not in use, lowest frame number on top at the start
+	int *free_frames;
+	unsigned nfree;
+
+	// The processes seen so far, and the one being replayed. pgdir is the
+	// current process' top-level page table (also known as the 'page
+	// directory'), and layout says how many levels hang off it.
+	struct proc **procs;
+	int nprocs;
+	struct proc *proc;
+	pgdir_entry_t *pgdir;
+	const struct pgtbl_layout *layout;
+
+	// Bytes of page directories and lower-level tables actually allocated
+	unsigned long pgtbl_bytes;
+
+	struct swap *swap;
+
+	// Simulated TLB in front of the page table, NULL if disabled (-T)
+	struct tlb *tlb;
+
+	// Pool of 2MB huge page frames, NULL if disabled (-H)
+	struct huge *huge;
+
+	// Log of every event, NULL if disabled (-E)
+	struct evlog *evlog;
+
+	// Set while several threads replay the instance (-c). Status bits are
+	// then changed with pte_set_atomic() and pte_clear_atomic(), as other
+	// threads may be reading entries, or setting REF or DIRTY, unlocked.
+	int concurrent;
+
+	// Read-ahead on misses, NULL if disabled (-P). The baseline is a twin
+	// instance replaying the same references without it, for comparison.
+	struct prefetch *prefetch;
+	struct sim *baseline;
+
+	// Counters for various events.
+	int hit_count;
+	int miss_count;
+	int ref_count;
+	int evict_clean_count;
+	int evict_dirty_count;
+
+	// Pages prefetched, those referenced before being evicted (hits that
+	// would otherwise have been misses), and those evicted unreferenced
+	int prefetch_count;
+	int prefetch_hit_count;
+	int prefetch_wasted_count;
+
+	// Simulated latency of the run, if there is a cost model (-C)
+	struct cost cost;
+
+	// Resident set time series, if sampled (-R)
+	struct rss_sample *samples;
+	int nsamples;
+};
+
+extern struct sim *sim_create(struct functions *alg, unsigned memsize,
+                              unsigned swapsize, trace_t *trace);
+
+extern void sim_destroy(struct sim *s);
 
 #endif // __SIM_H 
@@ -5,6 +5,9 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <pthread.h>
 #include "pagetable.h"
 #include "sim.h"
 
@@ -14,6 +17,12 @@
 // on demand with a little effort.
 //
 // The bitmap code is modified from the OS/161 bitmap functions.
+//
+// Allocation is next-fit: the search starts at the word the previous
+// allocation came from. A second-level summary bitmap has one bit per word
+// of the main bitmap, set when that word is full, so full words are skipped
+// 32 at a time, and free bits are found with __builtin_ctz rather than bit
+// by bit.
 
 #define BITS_PER_WORD 32 // Assumes sizeof(unsigned) = 4 bytes, 32 bits
 #define WORD_ALLBITS    (0xffffffff)
@@ -23,12 +32,42 @@
 struct bitmap {
     unsigned nbits;
     unsigned *v;
+    unsigned nwords;     // Words in v
+    unsigned *full;      // Summary: bit ix set if v[ix] is full
+    unsigned nfull;      // Words in full
+    unsigned cursor;     // Word of the last allocation (next-fit)
 };
 
+static
+inline
+void
+bitmap_translate(unsigned bitno, unsigned *ix, unsigned *mask) {
+    unsigned offset;
+    *ix = bitno / BITS_PER_WORD;
+    offset = bitno % BITS_PER_WORD;
+    *mask = ((unsigned) 1) << offset;
+}
+
+// Keeps the summary bit for word ix in step with v[ix]
+static
+inline
+void
+bitmap_update_summary(struct bitmap *b, unsigned ix) {
+    unsigned six, smask;
+
+    bitmap_translate(ix, &six, &smask);
+    if (b->v[ix] == WORD_ALLBITS) {
+        b->full[six] |= smask;
+    } else {
+        b->full[six] &= ~smask;
+    }
+}
+
 struct bitmap *
 bitmap_create(unsigned nbits) {
     struct bitmap *b;
     unsigned words;
+    unsigned ix;
 
     words = DIVROUNDUP(nbits, BITS_PER_WORD);
     b = (struct bitmap *) malloc(sizeof(struct bitmap));
@@ -40,9 +79,19 @@ bitmap_create(unsigned nbits) {
         free(b);
         return NULL;
     }
+    b->nfull = DIVROUNDUP(words, BITS_PER_WORD);
+    b->full = malloc(b->nfull * sizeof(unsigned));
+    if (b->full == NULL) {
+        free(b->v);
+        free(b);
+        return NULL;
+    }
 
     memset(b->v, 0, words * sizeof(unsigned));
+    memset(b->full, 0, b->nfull * sizeof(unsigned));
     b->nbits = nbits;
+    b->nwords = words;
+    b->cursor = 0;
 
     /* Mark any leftover bits at the end in use */
     if (words > nbits / BITS_PER_WORD) {
@@ -57,43 +106,53 @@ bitmap_create(unsigned nbits) {
         }
     }
 
+    /* Likewise the summary bits past the last word, which are never free */
+    for (ix = words; ix < b->nfull * BITS_PER_WORD; ix++) {
+        b->full[ix / BITS_PER_WORD] |= ((unsigned) 1) << (ix % BITS_PER_WORD);
+    }
+
     return b;
 }
 
 int
 bitmap_alloc(struct bitmap *b, unsigned *index) {
-    unsigned ix;
-    unsigned maxix = DIVROUNDUP(b->nbits, BITS_PER_WORD);
-    unsigned offset;
+    unsigned six, ix, offset, n;
+    unsigned start = b->cursor / BITS_PER_WORD;
 
-    for (ix = 0; ix < maxix; ix++) {
-        if (b->v[ix] != WORD_ALLBITS) {
-            for (offset = 0; offset < BITS_PER_WORD; offset++) {
-                unsigned mask = ((unsigned) 1) << offset;
-
-                if ((b->v[ix] & mask) == 0) {
-                    b->v[ix] |= mask;
-                    *index = (ix * BITS_PER_WORD) + offset;
-                    assert(*index < b->nbits);
-                    return 0;
-                }
-            }
-            assert(0);
+    if (b->nwords == 0) {
+        return 1;
+    }
+
+    // Visit each summary word once, starting at the cursor's and wrapping
+    // around; the first visit ignores words before the cursor, so a final
+    // extra visit picks those up.
+    for (n = 0; n <= b->nfull; n++) {
+        unsigned notfull;
+
+        six = (start + n) % b->nfull;
+        notfull = ~b->full[six];
+        if (n == 0) {
+            notfull &= WORD_ALLBITS << (b->cursor % BITS_PER_WORD);
+        }
+        if (notfull == 0) {
+            continue;
         }
+
+        ix = six * BITS_PER_WORD + __builtin_ctz(notfull);
+        assert(ix < b->nwords && b->v[ix] != WORD_ALLBITS);
+
+        offset = __builtin_ctz(~b->v[ix]);
+        b->v[ix] |= ((unsigned) 1) << offset;
+        bitmap_update_summary(b, ix);
+        b->cursor = ix;
+
+        *index = (ix * BITS_PER_WORD) + offset;
+        assert(*index < b->nbits);
+        return 0;
     }
     return 1;
 }
 
-static
-inline
-void
-bitmap_translate(unsigned bitno, unsigned *ix, unsigned *mask) {
-    unsigned offset;
-    *ix = bitno / BITS_PER_WORD;
-    offset = bitno % BITS_PER_WORD;
-    *mask = ((unsigned) 1) << offset;
-}
-
 void bitmap_mark(struct bitmap *b, unsigned index) {
     unsigned ix;
     unsigned mask;
@@ -103,6 +162,7 @@ void bitmap_mark(struct bitmap *b, unsigned index) {
 
     assert((b->v[ix] & mask) == 0);
     b->v[ix] |= mask;
+    bitmap_update_summary(b, ix);
 }
 
 void bitmap_unmark(struct bitmap *b, unsigned index) {
@@ -114,6 +174,7 @@ void bitmap_unmark(struct bitmap *b, unsigned index) {
 
     assert((b->v[ix] & mask) != 0);
     b->v[ix] &= ~mask;
+    bitmap_update_summary(b, ix);
 }
 
 
@@ -128,65 +189,68 @@ int bitmap_isset(struct bitmap *b, unsigned index) {
 void
 bitmap_destroy(struct bitmap *b) {
     free(b->v);
+    free(b->full);
     free(b);
 }
 
 //---------------------------------------------------------------------
-// Swap definitions and functions.
-
-static int swapfd;
-static struct bitmap *swapmap;
-static char *fname;
+// Swap backends. Each backend is represented by a structure with its name
+// and the functions that store and fetch page data at a byte offset:
+//   file - lseek + read/write on a temporary swapfile (the default, for
+//          fidelity with a real swap device)
+//   mem  - a malloc'd arena, so page transfers are a memcpy
+//   mmap - the swapfile mapped into memory, also a memcpy per transfer
+//   async - the swapfile, with page-outs queued and written behind by a
+//          writer thread that coalesces adjacent slots into pwritev calls
+
+struct swap;
+
+struct swap_backend {
+    char *name;
+    void (*open)(struct swap *swap, unsigned swapsize);
+    int (*read)(struct swap *swap, char *frame_ptr, int swap_offset);
+    int (*write)(struct swap *swap, char *frame_ptr, int swap_offset);
+    void (*close)(struct swap *swap);
+};
 
-int swap_init(unsigned swapsize) {
+// Each simulator instance has its own swap space and bitmap
+struct swap {
+    struct swap_backend *backend;
+    struct bitmap *swapmap;
+    int swapfd;      // file and mmap backends
+    char *fname;
+    char *arena;     // mem and mmap backends
+    size_t arena_len;
+    struct writebehind *wb; // async backend
+};
 
-    // Initialize the swap file
-    fname = malloc(20);
-    strncpy(fname, "swapfile.XXXXXX", 20);
-    if ((swapfd = mkstemp(fname)) == -1) {
+static void swapfile_create(struct swap *swap) {
+    swap->fname = malloc(20);
+    strncpy(swap->fname, "swapfile.XXXXXX", 20);
+    if ((swap->swapfd = mkstemp(swap->fname)) == -1) {
         perror("Failed to create temporary file for swap");
         exit(1);
     }
-
-    // Initialize the bitmap
-    if ((swapmap = bitmap_create(swapsize)) == NULL) {
-        fprintf(stderr, "Failed to create bitmap for swap\n");
-        exit(1);
-    }
-
-    return 0;
 }
 
-void swap_destroy() {
+static void swapfile_remove(struct swap *swap) {
+    close(swap->swapfd);
+    unlink(swap->fname);
+    free(swap->fname);
+}
 
-    // Close and remove swapfile
-    close(swapfd);
-    unlink(fname);
+//region FILE BACKEND
 
-    // Destroy bitmap
-    bitmap_destroy(swapmap);
-    return;
+static void file_open(struct swap *swap, unsigned swapsize) {
+    swapfile_create(swap);
 }
 
-// Read data into (simulated) physical memory 'frame' from 'swap_offset'
-// in swap file.
-// Input:  frame - the physical frame number (not byte offset) in physmem
-//         swap_offset - the byte position in the swap file.
-// Return: 0 on success, 
-//	   -errno on error or number of bytes read on partial read
-// 
-int swap_pagein(unsigned frame, int swap_offset) {
-    char *frame_ptr;
+static int file_read(struct swap *swap, char *frame_ptr, int swap_offset) {
     off_t pos;
     ssize_t bytes_read;
 
-    assert(swap_offset != INVALID_SWAP);
-
-    // Get pointer to page data in (simulated) physical memory
-    frame_ptr = &physmem[frame * SIMPAGESIZE];
-
     // Seek to position in swap file where this page was stored
-    pos = lseek(swapfd, swap_offset, SEEK_SET);
+    pos = lseek(swap->swapfd, swap_offset, SEEK_SET);
     if (pos != swap_offset) {
         assert(pos == (off_t) -1);
         perror("swap_pagein: failed to set read position");
@@ -194,7 +258,7 @@ int swap_pagein(unsigned frame, int swap_offset) {
     }
 
     // Read page data from swapfile into memory
-    bytes_read = read(swapfd, frame_ptr, SIMPAGESIZE);
+    bytes_read = read(swap->swapfd, frame_ptr, SIMPAGESIZE);
     if (bytes_read != SIMPAGESIZE) {
         fprintf(stderr, "swap_pagein: did not read whole page\n");
         return bytes_read;
@@ -202,22 +266,366 @@ int swap_pagein(unsigned frame, int swap_offset) {
     return 0;
 }
 
+static int file_write(struct swap *swap, char *frame_ptr, int swap_offset) {
+    off_t pos;
+    ssize_t bytes_written;
+
+    // Seek to position in swap file where this page will be stored
+    pos = lseek(swap->swapfd, swap_offset, SEEK_SET);
+    if (pos != swap_offset) {
+        assert(pos == (off_t) -1);
+        perror("swap_pageout: failed to set write position");
+        return -errno;
+    }
+
+    // Write page data from memory into swapfile
+    bytes_written = write(swap->swapfd, frame_ptr, SIMPAGESIZE);
+    if (bytes_written != SIMPAGESIZE) {
+        fprintf(stderr, "swap_pageout: did not write whole page\n");
+        return -1;
+    }
+    return 0;
+}
+
+static void file_close(struct swap *swap) {
+    swapfile_remove(swap);
+}
+
+//endregion
+
+//region MEMORY AND MMAP BACKENDS
+
+static void mem_open(struct swap *swap, unsigned swapsize) {
+    swap->arena_len = (size_t) swapsize * SIMPAGESIZE;
+    if ((swap->arena = calloc(swap->arena_len, 1)) == NULL) {
+        perror("Failed to allocate swap arena");
+        exit(1);
+    }
+}
+
+static void mem_close(struct swap *swap) {
+    free(swap->arena);
+}
+
+static void mmap_open(struct swap *swap, unsigned swapsize) {
+    swapfile_create(swap);
+    swap->arena_len = (size_t) swapsize * SIMPAGESIZE;
+    if (ftruncate(swap->swapfd, swap->arena_len) != 0) {
+        perror("Failed to size swapfile");
+        exit(1);
+    }
+    swap->arena = mmap(NULL, swap->arena_len, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, swap->swapfd, 0);
+    if (swap->arena == MAP_FAILED) {
+        perror("Failed to map swapfile");
+        exit(1);
+    }
+}
+
+static void mmap_close(struct swap *swap) {
+    munmap(swap->arena, swap->arena_len);
+    swapfile_remove(swap);
+}
+
+static int arena_read(struct swap *swap, char *frame_ptr, int swap_offset) {
+    assert(swap_offset + SIMPAGESIZE <= swap->arena_len);
+    memcpy(frame_ptr, swap->arena + swap_offset, SIMPAGESIZE);
+    return 0;
+}
+
+static int arena_write(struct swap *swap, char *frame_ptr, int swap_offset) {
+    assert(swap_offset + SIMPAGESIZE <= swap->arena_len);
+    memcpy(swap->arena + swap_offset, frame_ptr, SIMPAGESIZE);
+    return 0;
+}
+
+//endregion
+
+//region ASYNC (WRITE-BEHIND) BACKEND
+
+/* Page-outs are copied into the filling batch and return at once. A full
+ * batch is handed to the writer thread, which sorts it by offset and writes
+ * each run of adjacent slots with one pwritev. There is at most one batch
+ * in flight, so batches complete in order.
+ *
+ * pending[slot] is the number of the batch holding the slot's latest data
+ * (0 once written). A page-in of a pending slot first submits that batch if
+ * it is still filling, then waits for it, so reads always see the latest
+ * write.
+ */
+#define WB_BATCH 256 // Well under IOV_MAX (1024 on Linux)
+
+struct wb_batch {
+    int count;
+    int offsets[WB_BATCH];
+    char data[WB_BATCH][SIMPAGESIZE];
+};
+
+struct writebehind {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int fd;
+
+    struct wb_batch *filling;     // Owned by the simulator thread
+    struct wb_batch *inflight;    // Owned by the writer while busy
+    unsigned long filling_seq;    // Number of the filling batch
+    unsigned long submitted_seq;  // Latest batch handed to the writer
+    unsigned long completed_seq;  // Latest batch fully written
+    int busy;
+    int done;
+
+    unsigned long *pending;       // Per swap slot, see above
+};
+
+static int cmp_offsets(const void *a, const void *b) {
+    const int *x = a, *y = b;
+    return (*x > *y) - (*x < *y);
+}
+
+// Writes a batch, one pwritev per run of adjacent slots
+static void wb_write_batch(int fd, struct wb_batch *b) {
+    int order[WB_BATCH][2];  // offset, index into b->data
+    struct iovec iov[WB_BATCH];
+    int i, start;
+
+    for (i = 0; i < b->count; i++) {
+        order[i][0] = b->offsets[i];
+        order[i][1] = i;
+    }
+    qsort(order, b->count, sizeof(order[0]), cmp_offsets);
+
+    for (start = 0; start < b->count; start = i) {
+        int n = 0;
+        for (i = start; i < b->count; i++, n++) {
+            if (i > start && order[i][0] != order[i - 1][0] + SIMPAGESIZE) {
+                break;
+            }
+            iov[n].iov_base = b->data[order[i][1]];
+            iov[n].iov_len = SIMPAGESIZE;
+        }
+        if (pwritev(fd, iov, n, order[start][0]) != (ssize_t) n * SIMPAGESIZE) {
+            perror("swap_pageout: write-behind failed");
+        }
+    }
+}
+
+static void *wb_writer(void *arg) {
+    struct writebehind *wb = arg;
+
+    pthread_mutex_lock(&wb->lock);
+    while (1) {
+        while (!wb->busy && !wb->done) {
+            pthread_cond_wait(&wb->cond, &wb->lock);
+        }
+        if (!wb->busy) {
+            break;
+        }
+        pthread_mutex_unlock(&wb->lock);
+
+        wb_write_batch(wb->fd, wb->inflight);
+
+        pthread_mutex_lock(&wb->lock);
+        wb->completed_seq = wb->submitted_seq;
+        wb->busy = 0;
+        pthread_cond_broadcast(&wb->cond);
+    }
+    pthread_mutex_unlock(&wb->lock);
+    return NULL;
+}
+
+// Hands the filling batch to the writer, once the previous one is done
+static void wb_submit(struct writebehind *wb) {
+    struct wb_batch *tmp;
+
+    if (wb->filling->count == 0) {
+        return;
+    }
+    pthread_mutex_lock(&wb->lock);
+    while (wb->busy) {
+        pthread_cond_wait(&wb->cond, &wb->lock);
+    }
+    tmp = wb->inflight;
+    wb->inflight = wb->filling;
+    wb->filling = tmp;
+    wb->submitted_seq = wb->filling_seq++;
+    wb->busy = 1;
+    pthread_cond_broadcast(&wb->cond);
+    pthread_mutex_unlock(&wb->lock);
+
+    wb->filling->count = 0;
+}
+
+// Waits until batch seq has been written
+static void wb_wait(struct writebehind *wb, unsigned long seq) {
+    pthread_mutex_lock(&wb->lock);
+    while (wb->completed_seq < seq) {
+        pthread_cond_wait(&wb->cond, &wb->lock);
+    }
+    pthread_mutex_unlock(&wb->lock);
+}
+
+static void async_open(struct swap *swap, unsigned swapsize) {
+    struct writebehind *wb = calloc(1, sizeof(struct writebehind));
+
+    swapfile_create(swap);
+    wb->fd = swap->swapfd;
+    wb->filling = calloc(1, sizeof(struct wb_batch));
+    wb->inflight = calloc(1, sizeof(struct wb_batch));
+    wb->filling_seq = 1;
+    wb->pending = calloc(swapsize, sizeof(unsigned long));
+    pthread_mutex_init(&wb->lock, NULL);
+    pthread_cond_init(&wb->cond, NULL);
+    if (pthread_create(&wb->thread, NULL, wb_writer, wb) != 0) {
+        perror("Failed to create swap writer thread");
+        exit(1);
+    }
+    swap->wb = wb;
+}
+
+static int async_read(struct swap *swap, char *frame_ptr, int swap_offset) {
+    struct writebehind *wb = swap->wb;
+    unsigned long seq = wb->pending[swap_offset / SIMPAGESIZE];
+
+    if (seq != 0) {
+        if (seq == wb->filling_seq) {
+            wb_submit(wb);
+        }
+        wb_wait(wb, seq);
+        wb->pending[swap_offset / SIMPAGESIZE] = 0;
+    }
+    return file_read(swap, frame_ptr, swap_offset);
+}
+
+static int async_write(struct swap *swap, char *frame_ptr, int swap_offset) {
+    struct writebehind *wb = swap->wb;
+    struct wb_batch *b = wb->filling;
+
+    // A slot is paged in (which flushes it) before it can be evicted again,
+    // so it is never queued twice in one batch
+    assert(wb->pending[swap_offset / SIMPAGESIZE] != wb->filling_seq);
+
+    b->offsets[b->count] = swap_offset;
+    memcpy(b->data[b->count], frame_ptr, SIMPAGESIZE);
+    b->count++;
+    wb->pending[swap_offset / SIMPAGESIZE] = wb->filling_seq;
+
+    if (b->count == WB_BATCH) {
+        wb_submit(wb);
+    }
+    return 0;
+}
+
+static void async_close(struct swap *swap) {
+    struct writebehind *wb = swap->wb;
+
+    // Drain the queue and stop the writer
+    wb_submit(wb);
+    pthread_mutex_lock(&wb->lock);
+    wb->done = 1;
+    pthread_cond_broadcast(&wb->cond);
+    pthread_mutex_unlock(&wb->lock);
+    pthread_join(wb->thread, NULL);
+
+    pthread_mutex_destroy(&wb->lock);
+    pthread_cond_destroy(&wb->cond);
+    free(wb->filling);
+    free(wb->inflight);
+    free(wb->pending);
+    free(wb);
+    swapfile_remove(swap);
+}
+
+//endregion
+
+struct swap_backend swap_backends[] = {
+    {"file", file_open, file_read, file_write, file_close},
+    {"mem", mem_open, arena_read, arena_write, mem_close},
+    {"mmap", mmap_open, arena_read, arena_write, mmap_close},
+    {"async", async_open, async_read, async_write, async_close}
+};
+int num_swap_backends = 4;
+
+struct swap_backend *swap_find_backend(char *name) {
+    int i;
+    for (i = 0; i < num_swap_backends; i++) {
+        if (strcmp(swap_backends[i].name, name) == 0) {
+            return &swap_backends[i];
+        }
+    }
+    return NULL;
+}
+
+//---------------------------------------------------------------------
+// Swap definitions and functions.
+
+struct swap *swap_init(unsigned swapsize, struct swap_backend *backend) {
+    struct swap *swap = calloc(1, sizeof(struct swap));
+
+    // Initialize the swap space
+    swap->backend = backend != NULL ? backend : &swap_backends[0];
+    swap->backend->open(swap, swapsize);
+
+    // Initialize the bitmap
+    if ((swap->swapmap = bitmap_create(swapsize)) == NULL) {
+        fprintf(stderr, "Failed to create bitmap for swap\n");
+        exit(1);
+    }
+
+    return swap;
+}
+
+void swap_destroy(struct swap *swap) {
+
+    // Release the swap space (closes and removes any swapfile)
+    swap->backend->close(swap);
+
+    // Destroy bitmap
+    bitmap_destroy(swap->swapmap);
+    free(swap);
+    return;
+}
+
+// Read data into (simulated) physical memory 'frame' from 'swap_offset'
+// in swap space.
+// Input:  s - the simulator instance whose physmem and swap are used
+//         frame - the physical frame number (not byte offset) in physmem
+//         swap_offset - the byte position in the swap space.
+// Return: 0 on success, 
+//	   -errno on error or number of bytes read on partial read
+// 
+int swap_pagein(struct sim *s, unsigned frame, int swap_offset) {
+    // Get pointer to page data in (simulated) physical memory
+    return swap_read(s, &s->physmem[frame * SIMPAGESIZE], swap_offset);
+}
+
+// Like swap_pagein(), but into page data outside physmem (a huge page's)
+int swap_read(struct sim *s, char *page, int swap_offset) {
+    assert(swap_offset != INVALID_SWAP);
+
+    return s->swap->backend->read(s->swap, page, swap_offset);
+}
+
 // Write data from (simulated) physical memory 'frame' to 'swap_offset'
-// in swap file. Allocates space in swap file for virtual page if needed.
-// Input:  frame - the physical frame number (not byte offset in physmem)
-//         swap_offset - the byte position in the swap file.
+// in swap space. Allocates space in swap for virtual page if needed.
+// Input:  s - the simulator instance whose physmem and swap are used
+//         frame - the physical frame number (not byte offset in physmem)
+//         swap_offset - the byte position in the swap space.
 // Return: the swap_offset where the data was written on success,
 //         or INVALID_SWAP on failure
 // 
-int swap_pageout(unsigned frame, int swap_offset) {
-    char *frame_ptr;
-    off_t pos;
+int swap_pageout(struct sim *s, unsigned frame, int swap_offset) {
+    // Get pointer to page data in (simulated) physical memory
+    return swap_write(s, &s->physmem[frame * SIMPAGESIZE], swap_offset);
+}
+
+// Like swap_pageout(), but from page data outside physmem (a huge page's)
+int swap_write(struct sim *s, char *page, int swap_offset) {
     unsigned idx;
-    ssize_t bytes_written;
 
     // Check if swap has already been allocated for this page
     if (swap_offset == INVALID_SWAP) {
-        if (bitmap_alloc(swapmap, &idx) != 0) {
+        if (bitmap_alloc(s->swap->swapmap, &idx) != 0) {
             fprintf(stderr,
                     "swap_pageout: Could not allocate space in swapfile. Try running again with a larger swapsize.\n");
             return INVALID_SWAP;
@@ -226,21 +634,7 @@ int swap_pageout(unsigned frame, int swap_offset) {
     }
     assert(swap_offset != INVALID_SWAP);
 
-    // Get pointer to page data in (simulated) physical memory
-    frame_ptr = &physmem[frame * SIMPAGESIZE];
-
-    // Seek to position in swap file where this page will be stored
-    pos = lseek(swapfd, swap_offset, SEEK_SET);
-    if (pos != swap_offset) {
-        assert(pos == (off_t) -1);
-        perror("swap_pageout: failed to set write position");
-        return INVALID_SWAP;
-    }
-
-    // Read page data from swapfile into memory
-    bytes_written = write(swapfd, frame_ptr, SIMPAGESIZE);
-    if (bytes_written != SIMPAGESIZE) {
-        fprintf(stderr, "swap_pageout: did not write whole page\n");
+    if (s->swap->backend->write(s->swap, page, swap_offset) != 0) {
         return INVALID_SWAP;
     }
     return swap_offset;
@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tlb.h"
+
+//region DESCRIPTION OF TLB IMPLEMENTATION
+
+/*
+ * The TLB is an array of nsets * ways entries, set i being entries
+ * [i * ways, (i + 1) * ways). A page maps to set (page number % nsets), so
+ * lookups and inserts only scan ways entries.
+ *
+ * An entry caches a pointer to the page's PTE rather than a copy, so the
+ * simulator keeps updating the REF and DIRTY bits on hits exactly as it does
+ * after a walk; the page tables never move, so the pointer stays good until
+ * the page is evicted and the entry invalidated.
+ *
+ * A 2MB huge page (-H) takes one entry, keyed by its region number with
+ * HUGE_KEY set so it can't match a 4KB page, and caching its directory
+ * entry instead. Its set is chosen the same way, so a lookup probes the
+ * page's set and then the region's, the latter only while huge entries
+ * are cached.
+ *
+ * Replacement within a set fills empty entries first, then picks:
+ *      lru  - the entry with the oldest use stamp
+ *      fifo - entries in turn, from a per-set hand
+ *      rand - a pseudo-random entry (fixed seed, so runs repeat)
+ * */
+
+//endregion
+
+// Set in the key of a 2MB entry; virtual page numbers never reach it
+#define HUGE_KEY (1UL << 63)
+
+typedef struct {
+    addr_t key;             // Virtual page number, or HUGE_KEY | region
+    void* entry;            // Its pgtbl_entry_t, or pgdir_entry_t for a 2MB
+                            // page; NULL if the entry is empty
+    unsigned long stamp;    // Last use, for lru
+} TlbEntry;
+
+struct tlb {
+    unsigned nsets;
+    unsigned ways;
+    int policy;
+    TlbEntry* entries;
+    unsigned* hand;         // Per-set next victim, for fifo
+    unsigned long clock;    // Use stamps handed out so far, for lru
+    unsigned long seed;     // State for rand
+    unsigned nhuge;         // 2MB entries cached
+    unsigned long hits;
+    unsigned long misses;
+};
+
+int tlb_policy(const char* name) {
+    if (strcmp(name, "lru") == 0) {
+        return TLB_LRU;
+    }
+    if (strcmp(name, "fifo") == 0) {
+        return TLB_FIFO;
+    }
+    if (strcmp(name, "rand") == 0) {
+        return TLB_RAND;
+    }
+    return -1;
+}
+
+struct tlb* tlb_create(unsigned entries, unsigned ways, int policy) {
+    struct tlb* t;
+
+    if (entries == 0 || ways == 0 || entries % ways != 0) {
+        return NULL;
+    }
+    t = calloc(1, sizeof(struct tlb));
+    t->nsets = entries / ways;
+    t->ways = ways;
+    t->policy = policy;
+    t->entries = calloc(entries, sizeof(TlbEntry));
+    t->hand = calloc(t->nsets, sizeof(unsigned));
+    t->seed = 1;
+    return t;
+}
+
+void tlb_destroy(struct tlb* t) {
+    free(t->hand);
+    free(t->entries);
+    free(t);
+}
+
+// First entry of the set key maps to
+static TlbEntry* tlb_set(struct tlb* t, addr_t key) {
+    return &t->entries[(key % t->nsets) * t->ways];
+}
+
+// The entry caching key, or NULL
+static TlbEntry* tlb_find(struct tlb* t, addr_t key) {
+    TlbEntry* set = tlb_set(t, key);
+    unsigned i;
+
+    for (i = 0; i < t->ways; i++) {
+        if (set[i].entry != NULL && set[i].key == key) {
+            return &set[i];
+        }
+    }
+    return NULL;
+}
+
+pgtbl_entry_t* tlb_lookup(struct tlb* t, addr_t vaddr, pgdir_entry_t** pmd) {
+    TlbEntry* e = tlb_find(t, vaddr >> PAGE_SHIFT);
+
+    *pmd = NULL;
+    if (e == NULL && t->nhuge > 0) {
+        e = tlb_find(t, HUGE_KEY | vaddr >> HUGE_SHIFT);
+        if (e != NULL) {
+            e->stamp = ++t->clock;
+            t->hits++;
+            *pmd = e->entry;
+            return NULL;
+        }
+    }
+    if (e == NULL) {
+        t->misses++;
+        return NULL;
+    }
+    e->stamp = ++t->clock;
+    t->hits++;
+    return e->entry;
+}
+
+static void tlb_put(struct tlb* t, addr_t key, void* entry) {
+    TlbEntry* set = tlb_set(t, key);
+    unsigned i, victim = 0;
+
+    for (i = 0; i < t->ways; i++) {
+        if (set[i].entry == NULL) {
+            break;
+        }
+    }
+    if (i < t->ways) {
+        victim = i;
+    } else if (t->policy == TLB_LRU) {
+        for (i = 1; i < t->ways; i++) {
+            if (set[i].stamp < set[victim].stamp) {
+                victim = i;
+            }
+        }
+    } else if (t->policy == TLB_FIFO) {
+        unsigned* hand = &t->hand[key % t->nsets];
+        victim = *hand;
+        *hand = (*hand + 1) % t->ways;
+    } else {
+        // xorshift64
+        t->seed ^= t->seed << 13;
+        t->seed ^= t->seed >> 7;
+        t->seed ^= t->seed << 17;
+        victim = (unsigned) (t->seed % t->ways);
+    }
+
+    if (set[victim].entry != NULL && (set[victim].key & HUGE_KEY)) {
+        t->nhuge--;
+    }
+    if (key & HUGE_KEY) {
+        t->nhuge++;
+    }
+    set[victim].key = key;
+    set[victim].entry = entry;
+    set[victim].stamp = ++t->clock;
+}
+
+void tlb_insert(struct tlb* t, addr_t vaddr, pgtbl_entry_t* pte) {
+    tlb_put(t, vaddr >> PAGE_SHIFT, pte);
+}
+
+void tlb_insert_huge(struct tlb* t, addr_t vaddr, pgdir_entry_t* pmd) {
+    tlb_put(t, HUGE_KEY | vaddr >> HUGE_SHIFT, pmd);
+}
+
+void tlb_invalidate(struct tlb* t, addr_t vaddr) {
+    TlbEntry* e = tlb_find(t, vaddr >> PAGE_SHIFT);
+
+    if (e != NULL) {
+        e->entry = NULL;
+    }
+}
+
+void tlb_invalidate_huge(struct tlb* t, addr_t vaddr, pgdir_entry_t* pmd) {
+    TlbEntry* e = tlb_find(t, HUGE_KEY | vaddr >> HUGE_SHIFT);
+
+    if (e != NULL && e->entry == pmd) {
+        e->entry = NULL;
+        t->nhuge--;
+    }
+}
+
+void tlb_flush(struct tlb* t) {
+    memset(t->entries, 0, t->nsets * t->ways * sizeof(TlbEntry));
+    memset(t->hand, 0, t->nsets * sizeof(unsigned));
+    t->nhuge = 0;
+}
+
+unsigned long tlb_hits(struct tlb* t) {
+    return t->hits;
+}
+
+unsigned long tlb_misses(struct tlb* t) {
+    return t->misses;
+}
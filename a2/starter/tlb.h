@@ -0,0 +1,54 @@
+#ifndef __TLB_H__
+#define __TLB_H__
+
+#include "pagetable.h"
+
+/* A simulated translation lookaside buffer in front of the page table.
+ *
+ * Entries are grouped into sets of 'ways' entries; a virtual page can only
+ * be cached in the set its page number maps to, and a lookup searches just
+ * that set. ways == entries gives a fully associative TLB. A 2MB huge page
+ * (-H) takes a single entry. Entries carry no address space tag, so a page
+ * that leaves memory must be invalidated (shot down) explicitly.
+ */
+#define TLB_LRU  0
+#define TLB_FIFO 1
+#define TLB_RAND 2
+
+struct tlb;
+
+// Returns TLB_LRU/TLB_FIFO/TLB_RAND for "lru"/"fifo"/"rand", or -1
+extern int tlb_policy(const char* name);
+
+// entries must be a multiple of ways; returns NULL if it is not
+extern struct tlb* tlb_create(unsigned entries, unsigned ways, int policy);
+
+extern void tlb_destroy(struct tlb* t);
+
+// The cached translation for vaddr's page, or NULL on a TLB miss. If vaddr
+// is in a cached 2MB page, returns NULL with *pmd set to its directory
+// entry; otherwise *pmd is set to NULL.
+extern pgtbl_entry_t* tlb_lookup(struct tlb* t, addr_t vaddr,
+                                 pgdir_entry_t** pmd);
+
+// Caches the translation after a miss, replacing an entry in its set
+extern void tlb_insert(struct tlb* t, addr_t vaddr, pgtbl_entry_t* pte);
+
+// Caches the 2MB page pmd maps vaddr's region to
+extern void tlb_insert_huge(struct tlb* t, addr_t vaddr, pgdir_entry_t* pmd);
+
+// Drops vaddr's page, if cached
+extern void tlb_invalidate(struct tlb* t, addr_t vaddr);
+
+// Drops vaddr's 2MB page, if cached through pmd
+extern void tlb_invalidate_huge(struct tlb* t, addr_t vaddr,
+                                pgdir_entry_t* pmd);
+
+// Drops every entry
+extern void tlb_flush(struct tlb* t);
+
+extern unsigned long tlb_hits(struct tlb* t);
+
+extern unsigned long tlb_misses(struct tlb* t);
+
+#endif // __TLB_H__
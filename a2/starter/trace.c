@@ -0,0 +1,350 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sim.h"
+#include "trace.h"
+
+struct trace {
+    FILE* fp;                  // Text traces, or binary traces on a pipe
+    const unsigned char* map;  // Binary traces from a regular file
+    size_t map_len;
+    size_t pos;                // Read position within map
+    int binary;
+    uint32_t flags;
+    addr_t prev;               // Previous address, for delta decoding
+
+    struct trace_buf* buf;     // In-memory trace shared with other readers
+
+    // Optional lookahead: references read ahead of the one being returned
+    char* la_type;
+    addr_t* la_vaddr;
+    unsigned* la_pid;
+    unsigned la_slots;         // Window size + 1 (the current reference)
+    unsigned la_head;          // Slot of the next reference to return
+    unsigned la_count;         // References buffered
+    unsigned long la_time;     // Index in the trace of the next reference read
+    struct lookahead* la;      // Callbacks told about each reference read
+    int la_num;
+};
+
+struct lookahead {
+    trace_lookahead_fn fn;
+    void* arg;
+};
+
+//region ENCODING HELPERS
+
+static uint64_t zigzag_encode(int64_t v) {
+    return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static int64_t zigzag_decode(uint64_t v) {
+    return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+// Reads one byte from the trace, or returns EOF
+static int trace_getbyte(trace_t* t) {
+    if (t->map != NULL) {
+        if (t->pos >= t->map_len) {
+            return EOF;
+        }
+        return t->map[t->pos++];
+    }
+    return getc(t->fp);
+}
+
+// Reads an unsigned LEB128 varint. Returns 0 if the trace ends inside it,
+// or if it runs on past 64 bits.
+static int trace_getvarint(trace_t* t, uint64_t* v) {
+    int shift = 0;
+    int c;
+
+    *v = 0;
+    do {
+        if (shift >= 64) {
+            fprintf(stderr, "trace_next: corrupt trace\n");
+            return 0;
+        }
+        if ((c = trace_getbyte(t)) == EOF) {
+            fprintf(stderr, "trace_next: truncated record\n");
+            return 0;
+        }
+        *v |= (uint64_t) (c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    return 1;
+}
+
+// Appends v as an unsigned LEB128 varint to buf, returning its length
+static size_t put_varint(unsigned char* buf, uint64_t v) {
+    size_t len = 0;
+    do {
+        buf[len] = (unsigned char) (v & 0x7f);
+        v >>= 7;
+        if (v != 0) {
+            buf[len] |= 0x80;
+        }
+        len++;
+    } while (v != 0);
+    return len;
+}
+
+//endregion
+
+trace_t* trace_open(const char* path) {
+    trace_t* t = calloc(1, sizeof(trace_t));
+    struct trace_header hdr;
+    struct stat st;
+    int c;
+
+    if (path == NULL) {
+        t->fp = stdin;
+    } else if ((t->fp = fopen(path, "r")) == NULL) {
+        free(t);
+        return NULL;
+    }
+
+    // The first byte is enough to tell a binary trace from a text one
+    c = getc(t->fp);
+    if (c != (unsigned char) TRACE_MAGIC[0]) {
+        if (c != EOF) {
+            ungetc(c, t->fp);
+        }
+        return t;
+    }
+
+    hdr.magic[0] = (char) c;
+    if (fread(hdr.magic + 1, sizeof(hdr) - 1, 1, t->fp) != 1 ||
+        memcmp(hdr.magic, TRACE_MAGIC, TRACE_MAGIC_LEN) != 0 ||
+        hdr.version != TRACE_VERSION || (hdr.flags & ~TRACE_F_KNOWN)) {
+        fprintf(stderr, "trace_open: unrecognized binary trace header\n");
+        trace_close(t);
+        return NULL;
+    }
+    t->binary = 1;
+    t->flags = hdr.flags;
+
+    // Map regular files so records are decoded straight out of the page cache
+    if (fstat(fileno(t->fp), &st) == 0 && S_ISREG(st.st_mode) &&
+        st.st_size > sizeof(hdr)) {
+        void* map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE,
+                         fileno(t->fp), 0);
+        if (map != MAP_FAILED) {
+            madvise(map, (size_t) st.st_size, MADV_SEQUENTIAL);
+            t->map = map;
+            t->map_len = (size_t) st.st_size;
+            t->pos = sizeof(hdr);
+        }
+    }
+    return t;
+}
+
+int trace_is_binary(trace_t* t) {
+    return t->binary;
+}
+
+// Text traces: one "<type> <hex vaddr>[,size] [pid]" per line, valgrind
+// lines start with '='
+static int trace_next_text(trace_t* t, char* type, addr_t* vaddr,
+                           unsigned* pid) {
+    char buf[MAXLINE];
+    char* end;
+
+    while (fgets(buf, MAXLINE, t->fp) != NULL) {
+        if (buf[0] != '=') {
+            *type = buf[0];
+            *vaddr = strtoul(buf + 1, &end, 16);
+            end += strcspn(end, " \t\n"); // Skip a ",size" suffix
+            *pid = (unsigned) strtoul(end, NULL, 10);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int trace_next_binary(trace_t* t, char* type, addr_t* vaddr,
+                             unsigned* pid) {
+    uint64_t v;
+    int c = trace_getbyte(t);
+    if (c == EOF) {
+        return 0;
+    }
+    *type = (char) c;
+
+    if (t->flags & TRACE_F_DELTA) {
+        if (!trace_getvarint(t, &v)) {
+            return 0;
+        }
+        t->prev += (addr_t) zigzag_decode(v);
+        *vaddr = t->prev;
+    } else if (t->map != NULL) {
+        // Raw records: 8 little-endian address bytes
+        if (t->pos + sizeof(uint64_t) > t->map_len) {
+            fprintf(stderr, "trace_next: truncated record\n");
+            return 0;
+        }
+        memcpy(vaddr, t->map + t->pos, sizeof(uint64_t));
+        t->pos += sizeof(uint64_t);
+    } else if (fread(vaddr, sizeof(uint64_t), 1, t->fp) != 1) {
+        fprintf(stderr, "trace_next: truncated record\n");
+        return 0;
+    }
+
+    *pid = 0;
+    if (t->flags & TRACE_F_PID) {
+        if (!trace_getvarint(t, &v)) {
+            return 0;
+        }
+        *pid = (unsigned) v;
+    }
+    return 1;
+}
+
+static int trace_read(trace_t* t, char* type, addr_t* vaddr, unsigned* pid) {
+    if (t->buf != NULL) {
+        if (t->pos >= t->buf->nrefs) {
+            return 0;
+        }
+        *type = t->buf->types[t->pos];
+        *vaddr = t->buf->vaddrs[t->pos];
+        *pid = t->buf->pids[t->pos];
+        t->pos++;
+        return 1;
+    }
+    if (t->binary) {
+        return trace_next_binary(t, type, vaddr, pid);
+    }
+    return trace_next_text(t, type, vaddr, pid);
+}
+
+void trace_add_lookahead(trace_t* t, unsigned window, trace_lookahead_fn fn,
+                         void* arg) {
+    // Must be set up before reading; the largest window asked for wins
+    assert(t->la_time == 0);
+    if (window + 1 > t->la_slots) {
+        t->la_slots = window + 1;
+        t->la_type = realloc(t->la_type, t->la_slots * sizeof(char));
+        t->la_vaddr = realloc(t->la_vaddr, t->la_slots * sizeof(addr_t));
+        t->la_pid = realloc(t->la_pid, t->la_slots * sizeof(unsigned));
+    }
+    t->la = realloc(t->la, (t->la_num + 1) * sizeof(struct lookahead));
+    t->la[t->la_num].fn = fn;
+    t->la[t->la_num].arg = arg;
+    t->la_num++;
+}
+
+int trace_next(trace_t* t, char* type, addr_t* vaddr, unsigned* pid) {
+    int i;
+
+    if (t->la_num == 0) {
+        return trace_read(t, type, vaddr, pid);
+    }
+
+    // Keep the window full: the returned reference plus window more
+    while (t->la_count < t->la_slots) {
+        unsigned slot = (t->la_head + t->la_count) % t->la_slots;
+        if (!trace_read(t, &t->la_type[slot], &t->la_vaddr[slot],
+                        &t->la_pid[slot])) {
+            break;
+        }
+        for (i = 0; i < t->la_num; i++) {
+            t->la[i].fn(t->la[i].arg, t->la_type[slot], t->la_vaddr[slot],
+                        t->la_pid[slot], t->la_time);
+        }
+        t->la_time++;
+        t->la_count++;
+    }
+
+    if (t->la_count == 0) {
+        return 0;
+    }
+    *type = t->la_type[t->la_head];
+    *vaddr = t->la_vaddr[t->la_head];
+    *pid = t->la_pid[t->la_head];
+    t->la_head = (t->la_head + 1) % t->la_slots;
+    t->la_count--;
+    return 1;
+}
+
+struct trace_buf* trace_load(trace_t* t) {
+    struct trace_buf* b = malloc(sizeof(struct trace_buf));
+    size_t capacity = 1024;
+
+    b->nrefs = 0;
+    b->types = malloc(capacity * sizeof(char));
+    b->vaddrs = malloc(capacity * sizeof(addr_t));
+    b->pids = malloc(capacity * sizeof(unsigned));
+    while (trace_next(t, &b->types[b->nrefs], &b->vaddrs[b->nrefs],
+                      &b->pids[b->nrefs])) {
+        if (++b->nrefs == capacity) {
+            capacity *= 2;
+            b->types = realloc(b->types, capacity * sizeof(char));
+            b->vaddrs = realloc(b->vaddrs, capacity * sizeof(addr_t));
+            b->pids = realloc(b->pids, capacity * sizeof(unsigned));
+        }
+    }
+    return b;
+}
+
+trace_t* trace_open_buf(struct trace_buf* b) {
+    trace_t* t = calloc(1, sizeof(trace_t));
+    t->buf = b;
+    return t;
+}
+
+void trace_buf_destroy(struct trace_buf* b) {
+    free(b->types);
+    free(b->vaddrs);
+    free(b->pids);
+    free(b);
+}
+
+void trace_close(trace_t* t) {
+    if (t->map != NULL) {
+        munmap((void*) t->map, t->map_len);
+    }
+    if (t->fp != NULL && t->fp != stdin) {
+        fclose(t->fp);
+    }
+    free(t->la_type);
+    free(t->la_vaddr);
+    free(t->la_pid);
+    free(t->la);
+    free(t);
+}
+
+int trace_write_header(FILE* out, uint32_t flags, uint64_t nrefs) {
+    struct trace_header hdr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACE_MAGIC, TRACE_MAGIC_LEN);
+    hdr.version = TRACE_VERSION;
+    hdr.flags = flags;
+    hdr.nrefs = nrefs;
+    return fwrite(&hdr, sizeof(hdr), 1, out) == 1 ? 0 : -1;
+}
+
+int trace_write_record(FILE* out, uint32_t flags, char type,
+                       addr_t vaddr, unsigned pid, addr_t* prev) {
+    unsigned char buf[1 + 10 + 5];
+    size_t len = 0;
+
+    buf[len++] = (unsigned char) type;
+    if (flags & TRACE_F_DELTA) {
+        len += put_varint(buf + len, zigzag_encode((int64_t) (vaddr - *prev)));
+        *prev = vaddr;
+    } else {
+        uint64_t raw = vaddr;
+        memcpy(buf + len, &raw, sizeof(raw));
+        len += sizeof(raw);
+    }
+    if (flags & TRACE_F_PID) {
+        len += put_varint(buf + len, pid);
+    }
+    return fwrite(buf, len, 1, out) == 1 ? 0 : -1;
+}
@@ -0,0 +1,99 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include "pagetable.h"
+
+/* Binary trace format.
+ *
+ * A binary trace starts with a fixed header followed by one record per
+ * memory reference. Each record is a type byte ('I', 'L', 'S' or 'M')
+ * followed by the virtual address, either as 8 raw little-endian bytes or,
+ * when TRACE_F_DELTA is set, as a zigzag LEB128 varint holding the
+ * difference from the previous record's address. When TRACE_F_PID is set,
+ * the address is followed by the PID of the process making the reference,
+ * as an unsigned LEB128 varint.
+ *
+ * Text traces carry a PID as an optional decimal field after the address
+ * ("L 7ff000 42"). A reference without one is from PID 0.
+ *
+ * The first magic byte can never start a line of a text trace, so readers
+ * can tell the two formats apart from a single byte.
+ */
+#define TRACE_MAGIC      "\x89SIMTRC\n"
+#define TRACE_MAGIC_LEN  8
+#define TRACE_VERSION    1
+
+#define TRACE_F_DELTA    (0x1) // Addresses are delta + varint encoded
+#define TRACE_F_PID      (0x2) // Records carry a PID
+#define TRACE_F_KNOWN    (TRACE_F_DELTA | TRACE_F_PID)
+
+/* Each process has its own address space, so pages are named across
+ * processes by page number with the PID above it. Addresses have at most
+ * 48 bits (see find_pgtbl_layout), which leaves 28 bits of PID.
+ */
+#define TRACE_PID_SHIFT  (48 - PAGE_SHIFT)
+
+static inline addr_t trace_page(unsigned pid, addr_t vaddr) {
+    return ((addr_t) pid << TRACE_PID_SHIFT) | (vaddr >> PAGE_SHIFT);
+}
+
+struct trace_header {
+    char magic[TRACE_MAGIC_LEN];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t nrefs;     // Number of records that follow the header
+};
+
+// Opaque handle used to read either format
+typedef struct trace trace_t;
+
+// Opens path (or stdin if path is NULL), detecting the format.
+// Binary files are mmapped; binary data on a pipe is streamed.
+extern trace_t* trace_open(const char* path);
+
+// Reads the next reference. Returns 1 on success, 0 at end of trace.
+extern int trace_next(trace_t* t, char* type, addr_t* vaddr, unsigned* pid);
+
+/* Lookahead lets a caller see references before they are replayed. Once
+ * added, trace_next() reads up to window references past the one it returns
+ * and passes each to fn (with arg and its index in the trace) as it is read.
+ * Several callers may add themselves before the first read.
+ */
+typedef void (*trace_lookahead_fn)(void* arg, char type, addr_t vaddr,
+                                   unsigned pid, unsigned long time);
+
+extern void trace_add_lookahead(trace_t* t, unsigned window,
+                                trace_lookahead_fn fn, void* arg);
+
+/* A whole trace parsed into memory. It is never modified after loading, so
+ * any number of readers (one per thread, say) can replay it at once, each
+ * through its own trace_open_buf() handle.
+ */
+struct trace_buf {
+    char* types;
+    addr_t* vaddrs;
+    unsigned* pids;
+    size_t nrefs;
+};
+
+// Reads the rest of t into memory
+extern struct trace_buf* trace_load(trace_t* t);
+
+extern trace_t* trace_open_buf(struct trace_buf* b);
+
+extern void trace_buf_destroy(struct trace_buf* b);
+
+// Returns non-zero if t is reading a binary trace
+extern int trace_is_binary(trace_t* t);
+
+extern void trace_close(trace_t* t);
+
+// Writing binary traces (used by the tracecvt converter)
+extern int trace_write_header(FILE* out, uint32_t flags, uint64_t nrefs);
+
+extern int trace_write_record(FILE* out, uint32_t flags, char type,
+                              addr_t vaddr, unsigned pid, addr_t* prev);
+
+#endif // __TRACE_H__
@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "trace.h"
+
+/* Converts a text trace (as produced by traceprogs/runit) into the binary
+ * trace format read by sim. The reference count in the header is filled in
+ * after conversion when the output is seekable.
+ */
+int main(int argc, char* argv[]) {
+    int opt;
+    uint32_t flags = 0;
+    char* usage = "USAGE: tracecvt [-d] [-p] infile outfile\n"
+                  "       -d  delta-encode addresses\n"
+                  "       -p  keep the PID of each reference\n";
+
+    while ((opt = getopt(argc, argv, "dp")) != -1) {
+        switch (opt) {
+            case 'd':
+                flags |= TRACE_F_DELTA;
+                break;
+            case 'p':
+                flags |= TRACE_F_PID;
+                break;
+            default:
+                fprintf(stderr, "%s", usage);
+                exit(1);
+        }
+    }
+    if (argc - optind != 2) {
+        fprintf(stderr, "%s", usage);
+        exit(1);
+    }
+
+    trace_t* in = trace_open(argv[optind]);
+    if (in == NULL) {
+        perror("Error opening input trace");
+        exit(1);
+    }
+    FILE* out = fopen(argv[optind + 1], "w");
+    if (out == NULL) {
+        perror("Error opening output trace");
+        exit(1);
+    }
+
+    char type;
+    addr_t vaddr = 0;
+    addr_t prev = 0;
+    unsigned pid;
+    uint64_t nrefs = 0;
+
+    trace_write_header(out, flags, 0);
+    while (trace_next(in, &type, &vaddr, &pid)) {
+        if (trace_write_record(out, flags, type, vaddr, pid, &prev) != 0) {
+            perror("Error writing output trace");
+            exit(1);
+        }
+        nrefs++;
+    }
+
+    // Go back and record how many references were written
+    if (fseek(out, 0, SEEK_SET) == 0) {
+        trace_write_header(out, flags, nrefs);
+    }
+
+    trace_close(in);
+    if (fclose(out) != 0) {
+        perror("Error closing output trace");
+        exit(1);
+    }
+    printf("Converted %llu references\n", (unsigned long long) nrefs);
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <assert.h>
+#include <stdlib.h>
+#include "sim.h"
+#include "pagetable.h"
+#include "pagemap.h"
+
+extern int debug;
+
+//region DESCRIPTION OF 2Q IMPLEMENTATION
+
+/*
+ * Full 2Q (Johnson and Shasha, VLDB '94). New pages go into A1in, a FIFO of
+ * about a quarter of memory. Pages evicted from A1in are remembered in the
+ * ghost FIFO A1out (up to half of memory's worth); only a page referenced
+ * again while in A1out is taken to be hot and goes into Am, which is
+ * managed as LRU. Hits in A1in do nothing, so a burst of references to a
+ * page (or a scan) does not promote it.
+ *
+ * The three queues are lists in one PageMap, so every step is O(1).
+ * */
+
+//endregion
+
+#define AM      0
+#define A1IN    1
+#define A1OUT   2
+
+// Each instance's s->alg_data
+typedef struct {
+    PageMap* map;
+    int kin;    // Target size of A1in
+    int kout;   // Maximum size of A1out
+} TwoQ;
+
+int twoq_evict(struct sim* s) {
+    TwoQ* q = s->alg_data;
+    PageMap* m = q->map;
+    int victim, frame;
+
+    if (m->len[A1IN] > q->kin || m->len[AM] == 0) {
+        // Remember the page leaving A1in, forgetting the oldest ghost
+        victim = pagemap_tail(m, A1IN);
+        assert(victim != PM_NONE);
+        frame = m->nodes[victim].frame;
+        m->nodes[victim].frame = PM_NONE;
+        pagemap_move(m, victim, A1OUT);
+        if (m->len[A1OUT] > q->kout) {
+            pagemap_remove(m, pagemap_tail(m, A1OUT));
+        }
+    } else {
+        victim = pagemap_tail(m, AM);
+        frame = m->nodes[victim].frame;
+        pagemap_remove(m, victim);
+    }
+    return frame;
+}
+
+void twoq_ref(struct sim* s, pgtbl_entry_t* p) {
+    TwoQ* q = s->alg_data;
+    PageMap* m = q->map;
+    int node = pagemap_find(m, p);
+
+    if (node == PM_NONE) {
+        pagemap_add(m, p, (int) pte_frame(p), A1IN);
+    } else if (m->nodes[node].list == AM) {
+        pagemap_move(m, node, AM);
+    } else if (m->nodes[node].list == A1OUT) {
+        m->nodes[node].frame = (int) pte_frame(p);
+        pagemap_move(m, node, AM);
+    }
+    // Hits in A1in leave it where it is
+}
+
+void twoq_init(struct sim* s) {
+    TwoQ* q = malloc(sizeof(TwoQ));
+    q->kin = s->memsize / 4 > 0 ? s->memsize / 4 : 1;
+    q->kout = s->memsize / 2 > 0 ? s->memsize / 2 : 1;
+    q->map = pagemap_create(3, s->memsize + q->kout + 1);
+    s->alg_data = q;
+}
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <assert.h>
+#include <stdlib.h>
+#include "sim.h"
+#include "pagetable.h"
+
+extern int debug;
+
+//region DESCRIPTION OF WORKING SET AND PFF IMPLEMENTATION
+
+/*
+ * Local replacement: rather than waiting for memory to fill up and then
+ * evicting from anyone, these policies size each process' resident set on
+ * their own, freeing its frames with release_frame(). Time is measured per
+ * process, in references that process has made (its proc->ref_count).
+ *
+ *      ws  - Working set (Denning). A page stays resident while it has been
+ *            referenced in the last ws_tau references of its process; on
+ *            each reference the pages that have fallen out of the window
+ *            are released.
+ *      pff - Page fault frequency. When a process faults after more than
+ *            ws_tau references without one, its fault rate is low enough
+ *            to shrink it: pages not referenced since its previous fault
+ *            are released. Frequent faults only grow the resident set.
+ *
+ * Each process' resident frames are kept on a doubly-linked list through
+ * the frame numbers, most recently referenced (ws) or faulted in (pff)
+ * first, so ws trims from the tail in O(1) amortized per reference. pff
+ * scans the list only on the faults that shrink it.
+ *
+ * If memory does fill up anyway, the tail of the largest resident set is
+ * evicted. A real working set system would suspend a process instead.
+ * */
+
+//endregion
+
+// Each instance's s->alg_data
+typedef struct {
+    pgtbl_entry_t** page;   // Page each frame is listed for, or NULL
+    int* prev;              // Resident set lists, through frame numbers
+    int* next;
+    unsigned long* last;    // Owner's time of the frame's last reference
+} Local;
+
+// Each process' alg_data
+typedef struct {
+    int head, tail;         // Its resident frames, or -1
+    unsigned long last_fault;
+} LocalProc;
+
+static LocalProc* local_proc(struct proc* proc) {
+    if (proc->alg_data == NULL) {
+        LocalProc* lp = malloc(sizeof(LocalProc));
+        lp->head = lp->tail = -1;
+        lp->last_fault = 0;
+        proc->alg_data = lp;
+    }
+    return proc->alg_data;
+}
+
+static void list_push(Local* l, LocalProc* lp, int frame) {
+    l->prev[frame] = -1;
+    l->next[frame] = lp->head;
+    if (lp->head != -1) {
+        l->prev[lp->head] = frame;
+    } else {
+        lp->tail = frame;
+    }
+    lp->head = frame;
+}
+
+static void list_unlink(Local* l, LocalProc* lp, int frame) {
+    if (l->prev[frame] != -1) {
+        l->next[l->prev[frame]] = l->next[frame];
+    } else {
+        lp->head = l->next[frame];
+    }
+    if (l->next[frame] != -1) {
+        l->prev[l->next[frame]] = l->prev[frame];
+    } else {
+        lp->tail = l->prev[frame];
+    }
+}
+
+// Drops frame from its process' resident set and frees it
+static void release(struct sim* s, Local* l, LocalProc* lp, int frame) {
+    list_unlink(l, lp, frame);
+    l->page[frame] = NULL;
+    release_frame(s, frame);
+}
+
+// Memory is full: take the oldest frame of the largest resident set
+static int evict_largest(struct sim* s) {
+    Local* l = s->alg_data;
+    struct proc* largest = NULL;
+    int i;
+
+    for (i = 0; i < s->nprocs; i++) {
+        struct proc* proc = s->procs[i];
+        if (proc->alg_data != NULL && ((LocalProc*) proc->alg_data)->tail != -1 &&
+            (largest == NULL || proc->resident > largest->resident)) {
+            largest = proc;
+        }
+    }
+    assert(largest != NULL);
+
+    LocalProc* lp = largest->alg_data;
+    int victim = lp->tail;
+    list_unlink(l, lp, victim);
+    l->page[victim] = NULL;
+    return victim;
+}
+
+static void local_init(struct sim* s) {
+    Local* l = malloc(sizeof(Local));
+    l->page = calloc(s->memsize, sizeof(pgtbl_entry_t*));
+    l->prev = malloc(s->memsize * sizeof(int));
+    l->next = malloc(s->memsize * sizeof(int));
+    l->last = calloc(s->memsize, sizeof(unsigned long));
+    s->alg_data = l;
+}
+
+int ws_evict(struct sim* s) {
+    return evict_largest(s);
+}
+
+void ws_ref(struct sim* s, pgtbl_entry_t* p) {
+    Local* l = s->alg_data;
+    LocalProc* lp = local_proc(s->proc);
+    unsigned long now = (unsigned long) s->proc->ref_count;
+    int frame = (int) pte_frame(p);
+
+    if (l->page[frame] == p) {
+        list_unlink(l, lp, frame);
+    } else {
+        assert(l->page[frame] == NULL);
+        l->page[frame] = p;
+    }
+    list_push(l, lp, frame);
+    l->last[frame] = now;
+
+    // Release the pages that have left the working set
+    while (now - l->last[lp->tail] > ws_tau) {
+        release(s, l, lp, lp->tail);
+    }
+}
+
+void ws_init(struct sim* s) {
+    local_init(s);
+}
+
+int pff_evict(struct sim* s) {
+    return evict_largest(s);
+}
+
+void pff_ref(struct sim* s, pgtbl_entry_t* p) {
+    Local* l = s->alg_data;
+    LocalProc* lp = local_proc(s->proc);
+    unsigned long now = (unsigned long) s->proc->ref_count;
+    int frame = (int) pte_frame(p);
+    int f, next;
+
+    l->last[frame] = now;
+    if (l->page[frame] == p) {
+        return;
+    }
+
+    // A fault. If the last one was long enough ago, shrink to the pages
+    // used since then.
+    assert(l->page[frame] == NULL);
+    if (now - lp->last_fault > ws_tau) {
+        for (f = lp->head; f != -1; f = next) {
+            next = l->next[f];
+            if (l->last[f] < lp->last_fault) {
+                release(s, l, lp, f);
+            }
+        }
+    }
+    l->page[frame] = p;
+    list_push(l, lp, frame);
+    lp->last_fault = now;
+}
+
+void pff_init(struct sim* s) {
+    local_init(s);
+}